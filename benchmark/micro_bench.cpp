@@ -0,0 +1,201 @@
+#include "parser.h"
+#include "cpu.h"
+#include "memory.h"
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include <random>
+
+namespace hst {
+    Config Cfg;
+    Memory Mem;
+    HostIO Host;
+}
+
+namespace bench {
+using namespace hst;
+
+const static int N = 1 << 12;
+const static int defaultRounds = 2000;
+
+template<class T>
+inline void keep(T const &x) { asm volatile("" : : "r,m"(x) : "memory"); }
+
+int rounds = defaultRounds;
+const char *filter = nullptr;
+
+template<class F>
+void run(const char *name, F f) {
+    if (filter && !strstr(name, filter)) return;
+    f(); // warm up
+    auto st = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) f();
+    auto ed = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(ed - st).count();
+    printf("%-24s %12lld ops %10.3f ns/op\n", name, (long long)rounds * N, ns / ((double)rounds * N));
+}
+
+std::mt19937 rng(20231019);
+inline unsigned rnd(unsigned n) { return rng() % n; }
+inline unsigned reg5() { return rnd(32); }
+
+unsigned enc_R() {
+    static const unsigned f[10][2] = {{0, 0}, {0, 0x20}, {1, 0}, {2, 0}, {3, 0}, {4, 0}, {5, 0}, {5, 0x20}, {6, 0}, {7, 0}};
+    const unsigned *k = f[rnd(10)];
+    return k[1] << 25 | reg5() << 20 | reg5() << 15 | k[0] << 12 | reg5() << 7 | 0x33;
+}
+unsigned enc_I() {
+    static const unsigned f3[] = {0, 2, 3, 4, 6, 7, 1, 5};
+    unsigned funct3 = f3[rnd(8)], imm = rnd(4096);
+    if (funct3 == 1) imm &= 0x1f;
+    if (funct3 == 5) imm = (imm & 0x1f) | (rnd(2) ? 0x400 : 0);
+    return imm << 20 | reg5() << 15 | funct3 << 12 | reg5() << 7 | 0x13;
+}
+unsigned enc_L() {
+    static const unsigned f3[] = {0, 1, 2, 4, 5};
+    return rnd(4096) << 20 | reg5() << 15 | f3[rnd(5)] << 12 | reg5() << 7 | 0x03;
+}
+unsigned enc_S() {
+    unsigned imm = rnd(4096);
+    return (imm >> 5) << 25 | reg5() << 20 | reg5() << 15 | rnd(3) << 12 | (imm & 0x1f) << 7 | 0x23;
+}
+unsigned enc_B() {
+    static const unsigned f3[] = {0, 1, 4, 5, 6, 7};
+    unsigned imm = rnd(8192) & ~1u;
+    return ((imm >> 12) & 1) << 31 | ((imm >> 5) & 0x3f) << 25 | reg5() << 20 | reg5() << 15 | f3[rnd(6)] << 12
+         | ((imm >> 1) & 0xf) << 8 | ((imm >> 11) & 1) << 7 | 0x63;
+}
+unsigned enc_U() { return rnd(1 << 20) << 12 | reg5() << 7 | (rnd(2) ? 0x37 : 0x17); }
+unsigned enc_J() { return rnd(1 << 20) << 12 | reg5() << 7 | 0x6f; }
+unsigned enc_jalr() { return rnd(4096) << 20 | reg5() << 15 | reg5() << 7 | 0x67; }
+
+// roughly the dynamic mix of the course test programs
+unsigned enc_mix() {
+    unsigned x = rnd(100);
+    if (x < 35) return enc_I();
+    if (x < 55) return enc_L();
+    if (x < 65) return enc_S();
+    if (x < 80) return enc_B();
+    if (x < 90) return enc_R();
+    if (x < 95) return enc_U();
+    if (x < 98) return enc_J();
+    return enc_jalr();
+}
+
+template<class G>
+std::vector<unsigned> make(G g) {
+    std::vector<unsigned> v(N);
+    for (auto &x : v) x = g();
+    return v;
+}
+
+void decode_benches() {
+    auto mix = make(enc_mix);
+    run("decode/mix", [&] { for (unsigned x : mix) keep(decode(x)); });
+    auto r = make(enc_R), i = make(enc_I), l = make(enc_L), s = make(enc_S), b = make(enc_B), u = make(enc_U), j = make(enc_J);
+    run("decode/R", [&] { for (unsigned x : r) keep(decode(x)); });
+    run("decode/I", [&] { for (unsigned x : i) keep(decode(x)); });
+    run("decode/I(load)", [&] { for (unsigned x : l) keep(decode(x)); });
+    run("decode/S", [&] { for (unsigned x : s) keep(decode(x)); });
+    run("decode/B", [&] { for (unsigned x : b) keep(decode(x)); });
+    run("decode/U", [&] { for (unsigned x : u) keep(decode(x)); });
+    run("decode/J", [&] { for (unsigned x : j) keep(decode(x)); });
+}
+
+void alu_benches() {
+    ALU a;
+    std::vector<unsigned> op(N), x(N), y(N);
+    auto fill = [&](int lo, int hi) {
+        for (int k = 0; k < N; ++k) op[k] = lo + rnd(hi - lo + 1), x[k] = rng(), y[k] = rng();
+    };
+    fill(27, 36);
+    run("alu/run_R", [&] { for (int k = 0; k < N; ++k) keep(a.run_R(op[k], x[k], y[k])); });
+    fill(18, 26);
+    for (int k = 0; k < N; ++k) y[k] = op[k] >= 24 ? rnd(32) : rnd(4096);
+    run("alu/run_I", [&] { for (int k = 0; k < N; ++k) keep(a.run_I(op[k], x[k], y[k])); });
+    fill(10, 14);
+    for (int k = 0; k < N; ++k) x[k] = 0x10000 + rnd(1 << 20), y[k] = rnd(4096);
+    run("alu/run_I(load)", [&] { for (int k = 0; k < N; ++k) keep(a.run_I(op[k], x[k], y[k])); });
+    fill(4, 9);
+    run("alu/run_B", [&] { for (int k = 0; k < N; ++k) keep(a.run_B(op[k], x[k], y[k])); });
+    fill(15, 17);
+    run("alu/run_S", [&] { for (int k = 0; k < N; ++k) keep(a.run_S(x[k], y[k])); });
+    fill(0, 1);
+    run("alu/run_U", [&] { for (int k = 0; k < N; ++k) keep(a.run_U(op[k], y[k])); });
+}
+
+void memory_benches() {
+    Memory *m = &Mem;
+    std::vector<int> addr(N), width(N);
+    for (int k = 0; k < N; ++k) addr[k] = rnd(1 << 22) & ~3;
+    run("mem/fetch", [&] { for (int p : addr) keep(m->fetch(p)); });
+    for (int n : {1, 2, 4}) {
+        char name[32];
+        sprintf(name, "mem/load%d", n);
+        run(name, [&] { for (int p : addr) keep(m->load(p, n)); });
+        sprintf(name, "mem/store%d", n);
+        run(name, [&] { for (int p : addr) m->store(p, p, n); });
+    }
+    for (int k = 0; k < N; ++k) addr[k] = rnd(1 << 22), width[k] = 1 << rnd(3);
+    run("mem/load(unaligned)", [&] { for (int k = 0; k < N; ++k) keep(m->load(addr[k], width[k])); });
+}
+
+void bit_benches() {
+    std::vector<unsigned> x(N), n(N);
+    static const int widths[] = {8, 12, 13, 16, 21};
+    for (int k = 0; k < N; ++k) n[k] = widths[rnd(5)], x[k] = rng() & ((1u << n[k]) - 1);
+    run("sext", [&] { for (int k = 0; k < N; ++k) keep(sext(x[k], n[k])); });
+    for (int k = 0; k < N; ++k) x[k] = rng(), n[k] = rnd(24);
+    run("get_num", [&] { for (int k = 0; k < N; ++k) keep(get_num(x[k], n[k], n[k] + 7)); });
+}
+
+void predictor_benches() {
+    Predictor p;
+    std::vector<int> pc(N);
+    std::vector<char> taken(N);
+    // a few hot loop branches plus noisy data-dependent ones
+    for (int k = 0; k < N; ++k) {
+        pc[k] = (rnd(4) ? rnd(8) : rnd(1024)) << 2;
+        taken[k] = pc[k] < 32 ? (k % 7 != 0) : rnd(2);
+    }
+    run("predictor/predict", [&] { for (int k = 0; k < N; ++k) keep(p.predict(pc[k])); });
+    run("predictor/result", [&] { for (int k = 0; k < N; ++k) p.result(pc[k], taken[k]), keep(&p); });
+}
+
+void wakeup_benches() {
+    static Register Reg;
+    static ReservationStation RS_;
+    static LoadStoreBuffer LSB_;
+    static Bus Bus_;
+    static ReorderBuffer RoB_(&RS_, &LSB_, &Reg, &Bus_);
+    decoder d(&RoB_, &RS_, &LSB_, &Reg);
+    // fills the RoB with a chain of the given ops, each waiting on the one before it
+    auto fill = [&](std::initializer_list<unsigned> ops) {
+        RoB_.clear(0); RS_.clear(0); LSB_.clear(0); Reg.clear(0);
+        for (int k = 0; k < 32; ++k) {
+            d.issue(decode(ops.begin()[k % ops.size()]), 0, false, 0);
+            RoB_.update(0); RS_.update(0); LSB_.update(0); Reg.update(0);
+        }
+    };
+    std::vector<int> id(N);
+    for (int k = 0; k < N; ++k) id[k] = rnd(32);
+    fill({0x002080b3}); // add x1, x1, x2
+    run("rs/wakeup", [&] { for (int k = 0; k < N; ++k) RS_.bus(id[k], k, 1); });
+    fill({0x0000a083, 0x0010a023}); // lw x1, 0(x1); sw x1, 0(x1)
+    run("lsb/wakeup", [&] { for (int k = 0; k < N; ++k) LSB_.bus(id[k], k, 1); });
+}
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-r") && i + 1 < argc) bench::rounds = atoi(argv[++i]);
+        else bench::filter = argv[i];
+    }
+    bench::decode_benches();
+    bench::alu_benches();
+    bench::memory_benches();
+    bench::bit_benches();
+    bench::predictor_benches();
+    bench::wakeup_benches();
+    return 0;
+}
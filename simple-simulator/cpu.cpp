@@ -1,4 +1,6 @@
 #include "cpu.h"
 
 unsigned int hst::Register::x[32] = {0};
-unsigned int hst::Register::pc = 0;
\ No newline at end of file
+unsigned int hst::Register::pc = 0;
+hst::Memory hst::Mem;
+hst::HostIO hst::Host;
@@ -3,14 +3,16 @@
 
 #include "parser.h"
 #include "memory.h"
+#include "hostio.h"
+#include "devices.h"
 #include <memory>
 #include <bitset>
+#include <bit>
+#include <algorithm>
 
 namespace hst {
 
-inline signed int sext(unsigned int x, int n) { 
-    return x >> (n - 1) ? x | (0xffffffff >> n << n) : x;
-}
+extern Memory Mem;
 
 class Register {
 public:
@@ -25,56 +27,119 @@ public:
 class ALU {
 private:
     Register reg;
-    Memory m;
+    Memory *m = &Mem;
+    unsigned reserve;
+    bool reserved = false;
+    long long count = 0; // instructions executed, for the clock call
+    unsigned amo(int op, unsigned x, unsigned y) {
+        switch (op) {
+            case 47: return y;
+            case 48: return x + y;
+            case 49: return x ^ y;
+            case 50: return x & y;
+            case 51: return x | y;
+            case 52: return (signed)x < (signed)y ? x : y;
+            case 53: return (signed)x > (signed)y ? x : y;
+            case 54: return x < y ? x : y;
+            case 55: return x > y ? x : y;
+        }
+        throw;
+    }
+    // the same guest fault the pipeline raises at commit; memory is left alone
+    void fault(const char *f, unsigned addr) {
+        Host.flush();
+        std::cerr << f << " to " << std::hex << addr << " at pc " << reg.pc << std::dec << '\n';
+        exit(1);
+    }
 public:
-    int work(std::unique_ptr<instruction> o) {
-        o->print();
+    bool exited = false;
+    long long instructions() const { return count; }
+    int work(const MicroOp &o) {
+        ++count;
         int flag =  1;
-        // if (o->op == 5) std::cerr << "rs1= " << reg.x[o->get_rs1()] << ' ' << reg.x[o->get_rs2()] << '\n';
-        switch (o->op) {
-            case 0: { reg.x[o->get_rd()] = (signed int)(o->get_imm() << 12); } break;
-            case 1: { reg.x[o->get_rd()] = reg.pc + (signed int)(o->get_imm() << 12); } break;
-            case 2: { flag = 0; reg.x[o->get_rd()] = reg.pc + 4; reg.pc += sext(o->get_imm(), 21); } break;
-            case 3: { flag = 0; unsigned t = reg.pc + 4; reg.pc = (reg.x[o->get_rs1()] + sext(o->get_imm(), 12)) & ~1; reg.x[o->get_rd()] = t; } break;
-            case 4: { if(reg.x[o->get_rs1()] == reg.x[o->get_rs2()]) flag = 0, reg.pc += sext(o->get_imm(), 13); /*std::cerr << "rs== " << reg.x[o->get_rs1()] << ' ' <<  reg.x[o->get_rs2()]<< '\n';*/ } break;
-            case 5: { if(reg.x[o->get_rs1()] != reg.x[o->get_rs2()]) flag = 0, reg.pc += sext(o->get_imm(), 13); } break;
-            case 6: { if((signed)reg.x[o->get_rs1()] < (signed)reg.x[o->get_rs2()]) flag = 0, reg.pc += sext(o->get_imm(), 13); } break;
-            case 7: { if((signed)reg.x[o->get_rs1()] >= (signed)reg.x[o->get_rs2()]) flag = 0, reg.pc += sext(o->get_imm(), 13); } break;
-            case 8: { if(reg.x[o->get_rs1()] < reg.x[o->get_rs2()]) flag = 0, reg.pc += sext(o->get_imm(), 13); } break;
-            case 9: { if(reg.x[o->get_rs1()] >= reg.x[o->get_rs2()]) flag = 0, reg.pc += sext(o->get_imm(), 13); } break;
-            case 10: { reg.x[o->get_rd()] = sext(m.load(reg.x[o->get_rs1()] + sext(o->get_imm(), 12), 1), 8); } break;
-            case 11: { reg.x[o->get_rd()] = sext(m.load(reg.x[o->get_rs1()] + sext(o->get_imm(), 12), 2), 16); } break;
-            case 12: { reg.x[o->get_rd()] = m.load(reg.x[o->get_rs1()] + sext(o->get_imm(), 12), 4); } break;
-            case 13: { reg.x[o->get_rd()] = m.load(reg.x[o->get_rs1()] + sext(o->get_imm(), 12), 1); } break;
-            case 14: { reg.x[o->get_rd()] = m.load(reg.x[o->get_rs1()] + sext(o->get_imm(), 12), 2); } break;
-            case 15: { m.store(reg.x[o->get_rs1()] + sext(o->get_imm(), 12), reg.x[o->get_rs2()], 1); } break;
-            case 16: { m.store(reg.x[o->get_rs1()] + sext(o->get_imm(), 12), reg.x[o->get_rs2()], 2); } break;
-            case 17: { m.store(reg.x[o->get_rs1()] + sext(o->get_imm(), 12), reg.x[o->get_rs2()], 4); /*std::cerr << "store========= " << reg.x[o->get_rs1()] << ' ' << sext(o->get_imm(), 12) << '\n';*/ } break;
-            case 18: { reg.x[o->get_rd()] = reg.x[o->get_rs1()] + sext(o->get_imm(), 12); } break;
-            case 19: { reg.x[o->get_rd()] = ((signed)reg.x[o->get_rs1()] < (signed)sext(o->get_imm(), 12)); } break;
-            case 20: { reg.x[o->get_rd()] = ((unsigned)reg.x[o->get_rs1()] < (unsigned)sext(o->get_imm(), 12)); } break;
-            case 21: { reg.x[o->get_rd()] = reg.x[o->get_rs1()] ^ sext(o->get_imm(), 12); } break;
-            case 22: { reg.x[o->get_rd()] = reg.x[o->get_rs1()] | sext(o->get_imm(), 12); } break;
-            case 23: { reg.x[o->get_rd()] = reg.x[o->get_rs1()] & sext(o->get_imm(), 12); } break;
-            case 24: { reg.x[o->get_rd()] = reg.x[o->get_rs1()] << o->get_imm(); } break;
-            case 25: { reg.x[o->get_rd()] = reg.x[o->get_rs1()] >> o->get_imm(); } break;
-            case 26: { reg.x[o->get_rd()] = sext(reg.x[o->get_rs1()] >> o->get_imm(), 32 - o->get_imm()); } break;
-            case 27: { reg.x[o->get_rd()] = reg.x[o->get_rs1()] + reg.x[o->get_rs2()]; } break;
-            case 28: { reg.x[o->get_rd()] = reg.x[o->get_rs1()] - reg.x[o->get_rs2()]; } break;
-            case 29: { reg.x[o->get_rd()] = reg.x[o->get_rs1()] << reg.x[o->get_rs2()]; } break;
-            case 30: { reg.x[o->get_rd()] = ((signed)reg.x[o->get_rs1()] < (signed)reg.x[o->get_rs2()]); } break;
-            case 31: { reg.x[o->get_rd()] = ((unsigned)reg.x[o->get_rs1()] < (unsigned)reg.x[o->get_rs2()]); } break;
-            case 32: { reg.x[o->get_rd()] = reg.x[o->get_rs1()] ^ reg.x[o->get_rs2()]; } break;
-            case 33: { reg.x[o->get_rd()] = reg.x[o->get_rs1()] >> (reg.x[o->get_rs2()] & 0x1f); } break;
-            case 34: { reg.x[o->get_rd()] = sext(reg.x[o->get_rs1()] >> (reg.x[o->get_rs2()] & 0x1f), 32 - (reg.x[o->get_rs2()] & 0x1f)); } break;
-            case 35: { reg.x[o->get_rd()] = reg.x[o->get_rs1()] | reg.x[o->get_rs2()]; } break;
-            case 36: { reg.x[o->get_rd()] = reg.x[o->get_rs1()] & reg.x[o->get_rs2()]; } break;
+        if (o.is_A()) if (const char *f = Memory::atomic_fault(reg.x[o.rs1])) fault(f, reg.x[o.rs1]);
+        switch (o.op) {
+            case 0: { reg.x[o.rd] = o.imm; } break;
+            case 1: { reg.x[o.rd] = reg.pc + o.imm; } break;
+            case 2: { flag = 0; reg.x[o.rd] = reg.pc + o.len; reg.pc += o.imm; } break;
+            case 3: { flag = 0; unsigned t = reg.pc + o.len; reg.pc = (reg.x[o.rs1] + o.imm) & ~1; reg.x[o.rd] = t; } break;
+            case 4: { if(reg.x[o.rs1] == reg.x[o.rs2]) flag = 0, reg.pc += o.imm; } break;
+            case 5: { if(reg.x[o.rs1] != reg.x[o.rs2]) flag = 0, reg.pc += o.imm; } break;
+            case 6: { if((signed)reg.x[o.rs1] < (signed)reg.x[o.rs2]) flag = 0, reg.pc += o.imm; } break;
+            case 7: { if((signed)reg.x[o.rs1] >= (signed)reg.x[o.rs2]) flag = 0, reg.pc += o.imm; } break;
+            case 8: { if(reg.x[o.rs1] < reg.x[o.rs2]) flag = 0, reg.pc += o.imm; } break;
+            case 9: { if(reg.x[o.rs1] >= reg.x[o.rs2]) flag = 0, reg.pc += o.imm; } break;
+            case 10: { reg.x[o.rd] = sext(m->load(reg.x[o.rs1] + o.imm, 1), 8); } break;
+            case 11: { reg.x[o.rd] = sext(m->load(reg.x[o.rs1] + o.imm, 2), 16); } break;
+            case 12: { reg.x[o.rd] = m->load(reg.x[o.rs1] + o.imm, 4); } break;
+            case 13: { reg.x[o.rd] = m->load(reg.x[o.rs1] + o.imm, 1); } break;
+            case 14: { reg.x[o.rd] = m->load(reg.x[o.rs1] + o.imm, 2); } break;
+            case 15: { m->store(reg.x[o.rs1] + o.imm, reg.x[o.rs2], 1); } break;
+            case 16: { m->store(reg.x[o.rs1] + o.imm, reg.x[o.rs2], 2); } break;
+            case 17: { m->store(reg.x[o.rs1] + o.imm, reg.x[o.rs2], 4); } break;
+            case 18: { reg.x[o.rd] = reg.x[o.rs1] + o.imm; } break;
+            case 19: { reg.x[o.rd] = ((signed)reg.x[o.rs1] < o.imm); } break;
+            case 20: { reg.x[o.rd] = ((unsigned)reg.x[o.rs1] < (unsigned)o.imm); } break;
+            case 21: { reg.x[o.rd] = reg.x[o.rs1] ^ o.imm; } break;
+            case 22: { reg.x[o.rd] = reg.x[o.rs1] | o.imm; } break;
+            case 23: { reg.x[o.rd] = reg.x[o.rs1] & o.imm; } break;
+            case 24: { reg.x[o.rd] = reg.x[o.rs1] << o.imm; } break;
+            case 25: { reg.x[o.rd] = reg.x[o.rs1] >> o.imm; } break;
+            case 26: { reg.x[o.rd] = (int)reg.x[o.rs1] >> o.imm; } break;
+            case 27: { reg.x[o.rd] = reg.x[o.rs1] + reg.x[o.rs2]; } break;
+            case 28: { reg.x[o.rd] = reg.x[o.rs1] - reg.x[o.rs2]; } break;
+            case 29: { reg.x[o.rd] = reg.x[o.rs1] << reg.x[o.rs2]; } break;
+            case 30: { reg.x[o.rd] = ((signed)reg.x[o.rs1] < (signed)reg.x[o.rs2]); } break;
+            case 31: { reg.x[o.rd] = ((unsigned)reg.x[o.rs1] < (unsigned)reg.x[o.rs2]); } break;
+            case 32: { reg.x[o.rd] = reg.x[o.rs1] ^ reg.x[o.rs2]; } break;
+            case 33: { reg.x[o.rd] = reg.x[o.rs1] >> (reg.x[o.rs2] & 0x1f); } break;
+            case 34: { reg.x[o.rd] = (int)reg.x[o.rs1] >> (reg.x[o.rs2] & 0x1f); } break;
+            case 35: { reg.x[o.rd] = reg.x[o.rs1] | reg.x[o.rs2]; } break;
+            case 36: { reg.x[o.rd] = reg.x[o.rs1] & reg.x[o.rs2]; } break;
+            case 37: { reg.x[o.rd] = reg.x[o.rs1] * reg.x[o.rs2]; } break;
+            case 38: { reg.x[o.rd] = (long long)(signed)reg.x[o.rs1] * (signed)reg.x[o.rs2] >> 32; } break;
+            case 39: { reg.x[o.rd] = (long long)(signed)reg.x[o.rs1] * (unsigned long long)reg.x[o.rs2] >> 32; } break;
+            case 40: { reg.x[o.rd] = (unsigned long long)reg.x[o.rs1] * reg.x[o.rs2] >> 32; } break;
+            case 41: { unsigned a = reg.x[o.rs1], b = reg.x[o.rs2]; reg.x[o.rd] = !b ? -1 : (a == 0x80000000u && b == 0xffffffffu) ? a : (signed)a / (signed)b; } break;
+            case 42: { unsigned a = reg.x[o.rs1], b = reg.x[o.rs2]; reg.x[o.rd] = !b ? 0xffffffffu : a / b; } break;
+            case 43: { unsigned a = reg.x[o.rs1], b = reg.x[o.rs2]; reg.x[o.rd] = !b ? a : (a == 0x80000000u && b == 0xffffffffu) ? 0 : (signed)a % (signed)b; } break;
+            case 44: { unsigned a = reg.x[o.rs1], b = reg.x[o.rs2]; reg.x[o.rd] = !b ? a : a % b; } break;
+            case 45: { reserve = reg.x[o.rs1]; reserved = true; reg.x[o.rd] = m->load(reserve, 4); } break;
+            case 46: {
+                unsigned a = reg.x[o.rs1], ok = reserved && reserve == a;
+                if (ok) m->store(a, reg.x[o.rs2], 4);
+                reserved = false; reg.x[o.rd] = !ok;
+            } break;
+            case 47: case 48: case 49: case 50: case 51: case 52: case 53: case 54: case 55: {
+                unsigned a = reg.x[o.rs1], t = m->load(a, 4);
+                m->store(a, amo(o.op, t, reg.x[o.rs2]), 4);
+                reg.x[o.rd] = t;
+            } break;
+            case 56: { unsigned t = Host.call(m, reg.x, count); exited = reg.x[17] == HostIO::kExit; reg.x[10] = t; } break;
+            case 57: { reg.x[o.rd] = (reg.x[o.rs1] << 1) + reg.x[o.rs2]; } break;
+            case 58: { reg.x[o.rd] = (reg.x[o.rs1] << 2) + reg.x[o.rs2]; } break;
+            case 59: { reg.x[o.rd] = (reg.x[o.rs1] << 3) + reg.x[o.rs2]; } break;
+            case 60: { reg.x[o.rd] = reg.x[o.rs1] & ~reg.x[o.rs2]; } break;
+            case 61: { reg.x[o.rd] = reg.x[o.rs1] | ~reg.x[o.rs2]; } break;
+            case 62: { reg.x[o.rd] = ~(reg.x[o.rs1] ^ reg.x[o.rs2]); } break;
+            case 63: { reg.x[o.rd] = std::min((signed)reg.x[o.rs1], (signed)reg.x[o.rs2]); } break;
+            case 64: { reg.x[o.rd] = std::min(reg.x[o.rs1], reg.x[o.rs2]); } break;
+            case 65: { reg.x[o.rd] = std::max((signed)reg.x[o.rs1], (signed)reg.x[o.rs2]); } break;
+            case 66: { reg.x[o.rd] = std::max(reg.x[o.rs1], reg.x[o.rs2]); } break;
+            case 67: { reg.x[o.rd] = std::rotl(reg.x[o.rs1], reg.x[o.rs2] & 0x1f); } break;
+            case 68: { reg.x[o.rd] = std::rotr(reg.x[o.rs1], reg.x[o.rs2] & 0x1f); } break;
+            case 69: { reg.x[o.rd] = reg.x[o.rs1] & 0xffff; } break;
+            case 70: { reg.x[o.rd] = std::countl_zero(reg.x[o.rs1]); } break;
+            case 71: { reg.x[o.rd] = std::countr_zero(reg.x[o.rs1]); } break;
+            case 72: { reg.x[o.rd] = std::popcount(reg.x[o.rs1]); } break;
+            case 73: { reg.x[o.rd] = sext(reg.x[o.rs1], 8); } break;
+            case 74: { reg.x[o.rd] = sext(reg.x[o.rs1], 16); } break;
+            case 75: { unsigned a = reg.x[o.rs1], t = 0; for (int i = 0; i < 32; i += 8) if (a >> i & 0xff) t |= 0xffu << i; reg.x[o.rd] = t; } break;
+            case 76: { reg.x[o.rd] = __builtin_bswap32(reg.x[o.rs1]); } break;
+            case 77: { reg.x[o.rd] = std::rotr(reg.x[o.rs1], o.imm); } break;
+            case 78: break; // fence.i: every instruction is read from memory as it runs
         }
         if(reg.x[0]) reg.x[0] = 0;
-        // if (1) {
-        //     puts("end");
-        //     printf("rs1=%d rs2=%d rd=%d\n",reg.x[o->get_rs1()], reg.x[o->get_rs2()], reg.x[o->get_rd()]);
-        // }
         return flag;
     }
 };
@@ -82,21 +147,30 @@ public:
 class cabbage_cpu {
 private:
     ALU a;
-    decoder p;
-    Memory m;
+    Memory *m = &Mem;
     Register reg;
+    Devices dev{&Host, [this] { return a.instructions(); }};
 public:
     void work() {
-        m.init();
+        m->init();
+        dev.attach(m);
         while (1) {
-            unsigned ins = m.get(Register::pc); 
+            unsigned ins = m->fetch(Register::pc);
             if (ins == 0x0ff00513) break;
-            if (a.work(p.get_instruction(ins))) Register::pc += 4;;
-            if (reg.x[0]) break;
-            // reg.print();
+            MicroOp o = decode(ins);
+            if (!o.valid()) {
+                Host.flush();
+                std::cerr << "illegal instruction " << std::hex << (o.len == 2 ? ins & 0xffff : ins) << " at pc " << Register::pc << std::dec << '\n';
+                exit(1);
+            }
+            if (a.work(o)) Register::pc += o.len;
+            if (reg.x[0] || a.exited) break;
         }
-        cout << std::dec << (((unsigned int)reg.x[10]) & 255u) <<'\n';
+        Host.flush();
+        if (!a.exited) cout << std::dec << (((unsigned int)reg.x[10]) & 255u) <<'\n';
     }
+    bool exited() { return a.exited; }
+    unsigned result() { return ((unsigned int)reg.x[10]) & 255u; }
 };
 }
 #endif
@@ -4,8 +4,11 @@
 
 hst::cabbage_cpu T;
 
-int main() {
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--input") && i + 1 < argc && !hst::Host.load_input(argv[++i])) { std::cerr << "cannot read " << argv[i] << '\n'; return 1; }
+    }
     T.work();
     
-    return 0;
+    return T.exited() ? T.result() : 0;
 }
\ No newline at end of file
@@ -1,3 +0,0 @@
-#include "memory.h"
-
-unsigned char hst::Memory::mem[20000005];
\ No newline at end of file
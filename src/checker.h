@@ -0,0 +1,169 @@
+#ifndef RISC_V_CHECKER_H
+#define RISC_V_CHECKER_H
+
+#include "parser.h"
+#include "cpu.h"
+#include "memory.h"
+#include <iostream>
+#include <algorithm>
+
+namespace hst {
+
+// In-order functional model stepped once for every instruction the RoB retires.
+// It shares Mem with the pipeline: stores are only compared here and written by commit,
+// so loads on both sides always see the same committed memory.
+// Without a pipeline, execute() runs it alone, performing its own stores, atomics and host calls.
+class Checker {
+private:
+    const static int histSize = 16;
+    Memory *m;
+    HostIO *io;
+    ALU A;
+    unsigned x[32] = {}, pc = 0;
+    long long retired = 0;
+    unsigned histPc[histSize] = {}, histIns[histSize] = {};
+    // what the reference model produced for the current instruction
+    int op = -1, rd = 0;
+    bool wb = false, st = false;
+    unsigned ins = 0, npc = 0, value = 0, addr = 0, data = 0, width = 0;
+    // atomics are performed by the pipeline's commit before it retires them,
+    // so they are checked against the memory they left behind
+    bool at = false, reserveValid = false, exit = false;
+    bool dev = false; // a load from a device, whose value the reference cannot reproduce
+    unsigned reserveAddr = 0;
+    std::string reason;
+
+    void run() {
+        ins = m->fetch(pc);
+        MicroOp o = decode(ins);
+        npc = pc + 4; wb = st = at = exit = dev = false; rd = 0; value = addr = data = width = 0;
+        if (o.len == 2) ins &= 0xffff;
+        if (!o.valid()) { op = -1; return; }
+        op = o.op; npc = pc + o.len;
+        unsigned rs1 = x[o.rs1], rs2 = x[o.rs2];
+        if (o.is_U()) { wb = true; value = op ? pc + o.imm : o.imm; }
+        else if (o.is_J()) { wb = true; value = pc + o.len; npc = pc + o.imm; }
+        else if (op == 3) { wb = true; value = pc + o.len; npc = (rs1 + o.imm) & ~1; }
+        else if (o.is_B()) { if (A.run_B(op, rs1, rs2)) npc = pc + o.imm; }
+        else if (o.is_S()) {
+            st = true; width = 1 << (op - 15);
+            addr = A.run_S(rs1, o.imm);
+            data = width == 4 ? rs2 : rs2 & ((1u << (width * 8)) - 1);
+        }
+        else if (o.is_I()) { wb = true; dev = op >= 10 && op <= 14 && m->mapped(rs1 + o.imm); value = A.run_I(op, rs1, o.imm); }
+        else if (o.is_R()) { wb = true; value = A.run_R(op, rs1, rs2); }
+        else if (o.is_A()) { wb = at = true; addr = rs1; data = rs2; }
+        else if (op == 56) { wb = true; exit = x[17] == HostIO::kExit; }
+        if (wb) rd = o.rd;
+    }
+    bool compare(const RoBdata &v) {
+        if (op < 0) { reason = "reference cannot decode instruction"; return false; }
+        if (v.pc != pc) { reason = "pc"; return false; }
+        if (v.op != op) { reason = "op"; return false; }
+        if (st) {
+            unsigned got = width == 4 ? v.value : v.value & ((1u << (width * 8)) - 1);
+            if ((unsigned)v.dest != addr) { reason = "store address"; return false; }
+            if (got != data) { reason = "store data"; return false; }
+        }
+        else if (at) {
+            if (v.addr != addr) { reason = "atomic address"; return false; }
+            unsigned w = m->load(addr, 4);
+            if (op == 45) value = w;
+            else if (op == 46) {
+                value = !(reserveValid && reserveAddr == addr);
+                if (!value && w != data) { reason = "sc data"; return false; }
+            }
+            else {
+                value = v.value; // the old word, already replaced in memory
+                if (w != A.run_A(op, value, data)) { reason = "amo result"; return false; }
+            }
+            if (v.dest != rd) { reason = "destination register"; return false; }
+            if (rd && (unsigned)v.value != value) { reason = "destination value"; return false; }
+        }
+        else if (wb) {
+            if (op == 56 || dev) value = v.value; // the host call has already run in commit
+            if (v.dest != rd) { reason = "destination register"; return false; }
+            if (rd && (unsigned)v.value != value) { reason = "destination value"; return false; }
+        }
+        return true;
+    }
+public:
+    Checker(Memory *m_ = &Mem, HostIO *io_ = &Host): m(m_), io(io_), A(m_) {}
+    // Returns false on the first divergence; dump() then describes it.
+    bool step(const RoBdata &v) {
+        run();
+        histPc[retired % histSize] = pc; histIns[retired % histSize] = ins;
+        if (!compare(v)) return false;
+        if (wb && rd) x[rd] = value;
+        if (op == 45) reserveValid = true, reserveAddr = addr;
+        else if (op == 46) reserveValid = false;
+        else if ((st || at) && reserveValid && addr < reserveAddr + 4 && reserveAddr < addr + (st ? width : 4)) reserveValid = false;
+        pc = npc;
+        ++retired;
+        return true;
+    }
+    // The pipeline stopped at the halt instruction or the exit call; the reference must be there too.
+    bool finish() {
+        if (exit || m->fetch(pc) == 0x0ff00513) return true;
+        reason = "pipeline halted early";
+        ins = m->fetch(pc);
+        return false;
+    }
+    void dump(const RoBdata *v) {
+        std::cerr << std::hex;
+        std::cerr << "check: divergence (" << reason << ") after " << std::dec << retired << std::hex << " retired instructions\n";
+        std::cerr << "  reference: pc " << pc << " ins " << ins;
+        if (op >= 0) std::cerr << " (" << funcs[op] << ")";
+        if (st) std::cerr << " store [" << addr << "] = " << data << " width " << width;
+        else if (at) std::cerr << " atomic [" << addr << "] rs2 " << data << " x" << std::dec << rd << std::hex << " = " << value;
+        else if (wb) std::cerr << " x" << std::dec << rd << std::hex << " = " << value;
+        std::cerr << " next pc " << npc << '\n';
+        if (v) {
+            std::cerr << "  pipeline:  pc " << v->pc << " op " << std::dec << v->op;
+            if (v->op >= 0 && v->op < funcNum) std::cerr << " (" << funcs[v->op] << ")";
+            std::cerr << std::hex << " dest " << v->dest << " value " << (unsigned)v->value << '\n';
+        }
+        std::cerr << "  last retired:";
+        for (long long i = std::max(0ll, retired - histSize + 1); i <= retired; ++i)
+            std::cerr << ' ' << histPc[i % histSize] << ':' << histIns[i % histSize];
+        std::cerr << "\n  reference registers:";
+        for (int i = 0; i < 32; ++i) std::cerr << (i % 8 ? " " : "\n    ") << x[i];
+        std::cerr << std::dec << '\n';
+    }
+    long long count() { return retired; }
+    // -1 at the halt word or the exit call, otherwise whether it ended a basic block;
+    // an illegal instruction stops the run as it does in the engines
+    int execute() {
+        if (m->fetch(pc) == 0x0ff00513) return -1;
+        run();
+        if (op < 0) {
+            io->flush();
+            std::cerr << "illegal instruction " << std::hex << ins << " at pc " << pc << std::dec << '\n';
+            std::exit(1);
+        }
+        if (st) m->store(addr, data, width);
+        else if (at) {
+            if (const char *f = Memory::atomic_fault(addr)) {
+                io->flush();
+                std::cerr << f << " to " << std::hex << addr << " at pc " << pc << std::dec << '\n';
+                std::exit(1);
+            }
+            if (op == 45) value = m->load_reserved(0, addr);
+            else if (op == 46) value = !m->store_conditional(0, addr, data);
+            else { int o = op; unsigned y = data; value = m->amo(addr, [=](unsigned w) { return ALU::run_A(o, w, y); }); }
+        }
+        else if (op == 56) {
+            value = io->call(m, x, retired);
+            if (exit) { x[10] = value; return -1; }
+        }
+        if (wb && rd) x[rd] = value;
+        pc = npc; ++retired;
+        return is_B(op) || is_J(op) || op == 3;
+    }
+    const unsigned *regs() const { return x; }
+    unsigned where() const { return pc; }
+    bool exited() const { return exit; }
+};
+
+}
+#endif
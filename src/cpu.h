@@ -3,29 +3,42 @@
 
 #include "parser.h"
 #include "memory.h"
+#include "profiler.h"
+#include "hostio.h"
 #include <iostream>
 #include <memory>
 #include <functional>
 #include <random>
+#include <climits>
+#include <bit>
 
 namespace hst {
 
-inline signed int sext(unsigned int x, int n) {
-    return x >> (n - 1) ? x | (0xffffffff >> n << n) : x ^ (x >> n << n);
-}
+struct FUconfig {
+    int count, latency;
+    bool pipelined; // otherwise a unit is busy for its whole latency
+};
+
+struct Config {
+    FUconfig fu[FUnum] = {{2, 1, true}, {1, 1, true}, {1, 3, true}, {1, 32, false}, {1, 3, true}};
+    int wbPorts = 2; // results broadcast on the bus per cycle
+    unsigned fetchBlock = 8; // bytes read by fetch per cycle, a power of two
+    int fetchWidth = 2; // instructions fetched per cycle
+    int fetchQueue = 8; // entries between fetch and decode
+    unsigned uopCache = 1024; // predecoded instructions, a power of two; 0 turns it off
+    int loopBuffer = 16; // longest loop streamed from the loop buffer; 0 turns it off
+    bool fusion = false; // decode issues common adjacent pairs as one micro-op
+    int physRegs = 0; // registers of the renaming model, 33 or more; 0 forwards results through the RoB
+    bool skipIdle = true; // jump over cycles in which only latencies count down
+};
 
-inline bool is_R(int op) { return op >= 27 && op <= 36; }
-inline bool is_I(int op) { return op == 3 || (op >= 10 && op <= 14) || (op >= 18 && op <= 26); }
-inline bool is_S(int op) { return op >= 15 && op <= 17; }
-inline bool is_B(int op) { return op >= 4 && op <= 9; }
-inline bool is_U(int op) { return op == 0 || op == 1; }
-inline bool is_J(int op) { return op == 2; }
+extern Config Cfg;
 
 class Register {
 public:
-    unsigned int x[2][32];
-    unsigned int pc[2];
-    int q[2][32];
+    unsigned int x[2][32] = {};
+    unsigned int pc[2] = {};
+    int q[2][32] = {};
     void update(int clk) {
         pc[!clk] = pc[clk];
         for (int i = 1; i < 32; ++i) x[!clk][i] = x[clk][i], q[!clk][i] = q[clk][i];
@@ -44,36 +57,72 @@ public:
     }
 };
 
-extern Memory Mem;
-extern Register Reg;
+// Merged physical register file of the renaming model. Register::q maps each
+// architectural register to one of these; a result is written once, at writeback,
+// and issue reads it here. A register is freed at the commit of the next writer of the
+// same architectural register. The ready bits and the free list are double buffered like
+// the rest of the pipeline: issue allocates from the registers free at the end of the
+// last cycle, and a register freed at commit or by a recovery is reused from the next.
+class PhysRegs {
+public:
+    constexpr static int maxSize = 512;
+    unsigned v[maxSize] = {};
+    bool ready[2][maxSize] = {};
+    int freeList[maxSize] = {};
+    long long freeHead[2] = {}, freeTail[2] = {}, stalls = 0, used = 0; // used: registers in use summed over cycles
+    bool empty(int clk) { return freeHead[!clk] == freeTail[!clk]; }
+    int alloc(int clk) { int p = freeList[freeHead[clk]++ % maxSize]; ready[clk][p] = false; return p; }
+    void release(int p, int clk) { freeList[freeTail[clk]++ % maxSize] = p; }
+    int inUse(int clk) { return Cfg.physRegs - (freeTail[clk] - freeHead[clk]); }
+    void update(int clk) {
+        std::copy(ready[clk], ready[clk] + Cfg.physRegs, ready[!clk]);
+        freeHead[!clk] = freeHead[clk]; freeTail[!clk] = freeTail[clk];
+    }
+    // architectural register i starts in physical register i
+    void reset(const unsigned *x, Register *reg) {
+        freeHead[0] = freeTail[0] = 0;
+        for (int i = 0; i < 32; ++i) v[i] = x[i], ready[0][i] = ready[1][i] = true, reg->q[0][i] = reg->q[1][i] = i;
+        for (int i = 32; i < Cfg.physRegs; ++i) release(i, 0);
+        freeHead[1] = freeHead[0]; freeTail[1] = freeTail[0];
+    }
+};
 
 class ALU {
 private:
-    Memory *m = &Mem;
+    Memory *m;
 public:
+    ALU(Memory *m_ = &Mem): m(m_) {}
     int run_U(int op, unsigned imm) {
         switch (op) {
-            case 0: { return (signed int)(imm << 12); } break;
+            case 0: { return imm; } break;
             case 1: { return imm; } break;
         } 
         throw;
     }
     int run_I(int op, unsigned rs1, unsigned imm) {
         switch (op) {
-            case 10: { return sext(m->load(rs1 + sext(imm, 12), 1), 8); } break;
-            case 11: { return sext(m->load(rs1 + sext(imm, 12), 2), 16); } break;
-            case 12: { return m->load(rs1 + sext(imm, 12), 4); } break;
-            case 13: { return m->load(rs1 + sext(imm, 12), 1); } break;
-            case 14: { return m->load(rs1 + sext(imm, 12), 2); } break;
-            case 18: { return rs1 + sext(imm, 12); } break;
-            case 19: { return ((signed)rs1 < (signed)sext(imm, 12)); } break;
-            case 20: { return ((unsigned)rs1 < (unsigned)sext(imm, 12)); } break;
-            case 21: { return rs1 ^ sext(imm, 12); } break;
-            case 22: { return rs1 | sext(imm, 12); } break;
-            case 23: { return rs1 & sext(imm, 12); } break;
+            case 10: { return sext(m->load8(rs1 + imm), 8); } break;
+            case 11: { return sext(m->load16(rs1 + imm), 16); } break;
+            case 12: { return m->load32(rs1 + imm); } break;
+            case 13: { return m->load8(rs1 + imm); } break;
+            case 14: { return m->load16(rs1 + imm); } break;
+            case 18: { return rs1 + (int)imm; } break;
+            case 19: { return ((signed)rs1 < (signed)(int)imm); } break;
+            case 20: { return ((unsigned)rs1 < (unsigned)(int)imm); } break;
+            case 21: { return rs1 ^ (int)imm; } break;
+            case 22: { return rs1 | (int)imm; } break;
+            case 23: { return rs1 & (int)imm; } break;
             case 24: { return rs1 << imm; } break;
             case 25: { return rs1 >> imm; } break;
-            case 26: { return sext(rs1 >> imm, 32 - imm); } break;
+            case 26: { return (int)rs1 >> imm; } break;
+            case 70: { return std::countl_zero(rs1); } break;
+            case 71: { return std::countr_zero(rs1); } break;
+            case 72: { return std::popcount(rs1); } break;
+            case 73: { return sext(rs1, 8); } break;
+            case 74: { return sext(rs1, 16); } break;
+            case 75: { unsigned x = 0; for (int i = 0; i < 32; i += 8) if (rs1 >> i & 0xff) x |= 0xffu << i; return x; } break;
+            case 76: { return __builtin_bswap32(rs1); } break;
+            case 77: { return std::rotr(rs1, imm); } break;
         }
         throw;
     }
@@ -88,8 +137,8 @@ public:
         }
         throw;
     }
-    int run_S(int op, unsigned rs1, unsigned imm) {
-        return rs1 +sext(imm, 12);
+    int run_S(unsigned rs1, unsigned imm) {
+        return rs1 + imm;
     }
     int run_R(int op, unsigned rs1, unsigned rs2) {
         switch (op) {
@@ -100,9 +149,45 @@ public:
             case 31: { return ((unsigned)rs1 < (unsigned)rs2); } break;
             case 32: { return rs1 ^ rs2; } break;
             case 33: { return rs1 >> (rs2 & 0x1f); } break;
-            case 34: { return sext(rs1 >> (rs2 & 0x1f), 32 - (rs2 & 0x1f)); } break;
+            case 34: { return (int)rs1 >> (rs2 & 0x1f); } break;
             case 35: { return rs1 | rs2; } break;
             case 36: { return rs1 & rs2; } break;
+            case 37: { return rs1 * rs2; } break;
+            case 38: { return (long long)(signed)rs1 * (signed)rs2 >> 32; } break;
+            case 39: { return (long long)(signed)rs1 * (unsigned long long)rs2 >> 32; } break;
+            case 40: { return (unsigned long long)rs1 * rs2 >> 32; } break;
+            case 41: { if (!rs2) return -1; if (rs1 == 0x80000000u && rs2 == 0xffffffffu) return rs1; return (signed)rs1 / (signed)rs2; } break;
+            case 42: { if (!rs2) return -1; return rs1 / rs2; } break;
+            case 43: { if (!rs2) return rs1; if (rs1 == 0x80000000u && rs2 == 0xffffffffu) return 0; return (signed)rs1 % (signed)rs2; } break;
+            case 44: { if (!rs2) return rs1; return rs1 % rs2; } break;
+            case 57: { return (rs1 << 1) + rs2; } break;
+            case 58: { return (rs1 << 2) + rs2; } break;
+            case 59: { return (rs1 << 3) + rs2; } break;
+            case 60: { return rs1 & ~rs2; } break;
+            case 61: { return rs1 | ~rs2; } break;
+            case 62: { return ~(rs1 ^ rs2); } break;
+            case 63: { return std::min((signed)rs1, (signed)rs2); } break;
+            case 64: { return std::min(rs1, rs2); } break;
+            case 65: { return std::max((signed)rs1, (signed)rs2); } break;
+            case 66: { return std::max(rs1, rs2); } break;
+            case 67: { return std::rotl(rs1, rs2 & 0x1f); } break;
+            case 68: { return std::rotr(rs1, rs2 & 0x1f); } break;
+            case 69: { return rs1 & 0xffff; } break;
+        }
+        throw;
+    }
+    // new memory word of an amo from the old one and rs2
+    static unsigned run_A(int op, unsigned x, unsigned y) {
+        switch (op) {
+            case 47: return y;
+            case 48: return x + y;
+            case 49: return x ^ y;
+            case 50: return x & y;
+            case 51: return x | y;
+            case 52: return (signed)x < (signed)y ? x : y;
+            case 53: return (signed)x > (signed)y ? x : y;
+            case 54: return x < y ? x : y;
+            case 55: return x > y ? x : y;
         }
         throw;
     }
@@ -113,7 +198,7 @@ private:
     const static int maxSize = 1 << 6;
     const static int N = 4;
     const static int Size = 1 << N;
-    static int sum , success;
+    long long sum = 0, success = 0;
     int status[maxSize][Size] = {};
     int history[maxSize] = {};
 public:
@@ -130,17 +215,17 @@ public:
         int i = hash(pc);
         return (status[i][history[i]] >> 1) & 1;
     }
-    void result(int pc, bool taken) {
+    void result(int pc, bool taken) { // taken: the prediction was right
+        ++sum;
         int i = hash(pc);
         // if (i == 38) std::cerr <<"i=" << i << ' ' << taken << ' ' << history[i] << '\n';
-        if (taken) ++Predictor::success;
+        if (taken) ++success;
         bool jump = (get_prediction(pc) == taken);
         if (jump && status[i][history[i]] < 0b11) ++status[i][history[i]];
         if (!jump && status[i][history[i]]) --status[i][history[i]];
         history[i] = ((history[i] << 1) | jump) & (Size - 1);
     }
     bool predict(int pc) {
-        ++Predictor::sum;
         int i = hash(pc);
         // if (i == 38) std::cerr << "res=" << i << ' ' << ((status[i][history[i]] >> 1) & 1) << ' ' << history[i] << '\n';
         return (status[i][history[i]] >> 1) & 1;
@@ -149,7 +234,7 @@ public:
 
 class Bus {
 private:
-    bool flag[2];
+    bool flag[2] = {};
 public:
     void update(int clk) { flag[!clk] = flag[clk]; }
     void clear(int  clk) { flag[clk] = flag[!clk] = false; }
@@ -157,19 +242,56 @@ public:
     bool get_flag(int clk) { return flag[clk]; }
 };
 
-extern Bus Bus_;
+class FunctionalUnits {
+private:
+    const static int maxUnits = 8;
+    int busy[2][FUnum][maxUnits] = {}; // cycles left on a non-pipelined unit
+    int started[FUnum] = {}; // operations started this cycle
+    unsigned claimed[FUnum] = {}; // non-pipelined units started this cycle
+public:
+    long long issued[FUnum] = {}, waitUnit[FUnum] = {}, waitPort = 0;
+    void update(int clk) { for (int k = 0; k < FUnum; ++k) for (int u = 0; u < maxUnits; ++u) busy[!clk][k][u] = busy[clk][k][u]; }
+    void advance(int n) { for (int k = 0; k < FUnum; ++k) for (int u = 0; u < maxUnits; ++u) busy[0][k][u] = busy[1][k][u] = std::max(0, busy[0][k][u] - n); }
+    void clear(int clk) { for (int k = 0; k < FUnum; ++k) for (int u = 0; u < maxUnits; ++u) busy[clk][k][u] = busy[!clk][k][u] = 0; }
+    void tick(int clk) {
+        for (int k = 0; k < FUnum; ++k) {
+            started[k] = 0; claimed[k] = 0;
+            for (int u = 0; u < maxUnits; ++u) busy[clk][k][u] = busy[!clk][k][u] ? busy[!clk][k][u] - 1 : 0;
+        }
+    }
+    bool start(int k, int clk) {
+        FUconfig &f = Cfg.fu[k];
+        if (f.pipelined) {
+            if (started[k] == f.count) return false;
+        }
+        else {
+            int u = 0;
+            while (u < f.count && (busy[!clk][k][u] || claimed[k] >> u & 1)) ++u;
+            if (u == f.count) return false;
+            busy[clk][k][u] = f.latency - 1; claimed[k] |= 1u << u;
+        }
+        ++started[k]; ++issued[k];
+        return true;
+    }
+    void print() {
+        for (int k = 0; k < FUnum; ++k)
+            std::cerr << FUnames[k] << ": " << issued[k] << " issued, " << waitUnit[k] << " waits for a unit\n";
+        std::cerr << "writeback port waits: " << waitPort << '\n';
+    }
+};
 
 enum status{kcommit, kissue, kexcute, kwrite};
 
 struct RSdata {
     int busy, op, vj, vk, qj, qk, A, dest;
+    int fop, fA; // the second half of a fused pair, run on the first's result; fop -1 if none
 };
 
 class RSbase {
 private:
     const static int maxSize = 32;
-    RSdata v[2][maxSize];
-    int c[2][maxSize];
+    RSdata v[2][maxSize] = {};
+    int c[2][maxSize] = {};
 public:
     friend class ReservationStation;
     friend class LoadStoreBuffer;
@@ -179,7 +301,7 @@ public:
 
 class ReservationStation : public RSbase {
 private:
-    int size[2];
+    int size[2] = {};
 public:
     friend class ReorderBuffer;
     void update(int clk) { size[!clk] = size[clk]; for (int i = 0; i < maxSize; ++i) v[!clk][i] = v[clk][i], c[!clk][i] = c[clk][i]; }
@@ -189,18 +311,20 @@ public:
         size[!clk] = size[clk] = 0;
         for (int i = 0; i < maxSize; ++i) c[!clk][i] = c[clk][i] = 0;
     }
+    // wakes entries issued this cycle too, whichever of issue and writeback runs first
     void bus(int id, int value, int clk) {
         for (int i = 0; i < maxSize; ++i) {
-            if (!c[!clk][i]) continue;
-            if (v[!clk][i].qj == id) v[clk][i].vj = value, v[clk][i].qj = -1;
-            if (v[!clk][i].qk == id) v[clk][i].vk = value, v[clk][i].qk = -1;
+            RSdata *a = c[!clk][i] ? &v[!clk][i] : c[clk][i] ? &v[clk][i] : nullptr;
+            if (!a) continue;
+            if (a->qj == id) v[clk][i].vj = value, v[clk][i].qj = -1;
+            if (a->qk == id) v[clk][i].vk = value, v[clk][i].qk = -1;
         }
     }
 };
 
 class LoadStoreBuffer : public RSbase{
 private:
-    int size[2];
+    int size[2] = {};
 public:
     friend class ReorderBuffer;
     void update(int clk) { size[!clk] = size[clk]; for (int i = 0; i < maxSize; ++i) v[!clk][i] = v[clk][i], c[!clk][i] = c[clk][i]; }
@@ -210,22 +334,27 @@ public:
         size[!clk] = size[clk] = 0;
         for (int i = 0; i < maxSize; ++i) c[!clk][i] = c[clk][i] = 0;
     }
+    // wakes entries issued this cycle too, whichever of issue and writeback runs first
     void bus(int id, int value, int clk) {
         for (int i = 0; i < maxSize; ++i) {
-            if (!c[!clk][i]) continue;
-            if (v[!clk][i].qj == id) v[clk][i].vj = value, v[clk][i].qj = -1;
-            if (v[!clk][i].qk == id) v[clk][i].vk = value, v[clk][i].qk = -1;
+            RSdata *a = c[!clk][i] ? &v[!clk][i] : c[clk][i] ? &v[clk][i] : nullptr;
+            if (!a) continue;
+            if (a->qj == id) v[clk][i].vj = value, v[clk][i].qj = -1;
+            if (a->qk == id) v[clk][i].vk = value, v[clk][i].qk = -1;
         }
     }
 };
 
-extern ReservationStation RS_;
-extern LoadStoreBuffer LSB_;
-
 struct RoBdata {
-    int id, busy, dest, value, op;
+    int id, busy, dest, value, op; // busy: 1 executing, 2 an atomic waiting to perform at commit
+    unsigned pc, addr;
+    int fused, rd1, len1; // a fused pair: op, destination and length of its first half; op the second's
+    unsigned first; // the first half's result
+    int preg, old; // renaming: the physical register written, and the one it replaces in the map
     RoBdata() {}
-    RoBdata(int id_, int b_, int v_, int o_): id(id_), busy(b_), value(v_), op(o_), dest(0) {}
+    RoBdata(int id_, int b_, int v_, int o_, unsigned pc_): id(id_), busy(b_), dest(0), value(v_), op(o_), pc(pc_), addr(0), fused(-1), rd1(0), len1(0), first(0), preg(-1), old(-1) {}
+    // what readers of the entry's register see; a fused branch writes its compare's result
+    int result() const { return fused >= 0 && is_B(op) ? first : value; }
 };    
 
 class ReorderBuffer {
@@ -233,15 +362,30 @@ private:
     int cnt[2] = {}, size[2] = {}, block[2] = {}, head[2] = {};
     const static int maxSize = 32;
     RoBdata que[2][maxSize];
-    ReservationStation *RS = &RS_;
-    LoadStoreBuffer *LSB = &LSB_;
-    Register *reg = &Reg;
-    Memory *m = &Mem;
+    ReservationStation *RS;
+    LoadStoreBuffer *LSB;
+    Register *reg;
+    Bus *b;
+    Memory *m;
+    HostIO *io;
     ALU A;
     Predictor p;
+    int hart;
+    long long now = 0; // cycles, for the clock call
+    long long retired = 0, occupancy = 0; // instructions, and entries in use summed over cycles
+    long long recoveries = 0, squashed = 0;
+    int snap[maxSize][32] = {}; // Register::q as it stood after each branch issued
+    bool recovered = false; // a branch recovered this cycle
+    PhysRegs prf;
+    bool exited = false;
+    FunctionalUnits fu;
+    std::function<void(const RoBdata &)> retire;
+    Profiler *prof = nullptr;
 public:
     friend class decoder;
     friend class cabbage_cpu;
+    ReorderBuffer(ReservationStation *RS_, LoadStoreBuffer *LSB_, Register *reg_, Bus *b_, int hart_ = 0, Memory *m_ = &Mem, HostIO *io_ = &Host):
+        RS(RS_), LSB(LSB_), reg(reg_), b(b_), m(m_), io(io_), A(m_), hart(hart_) {}
     bool full(int clk) { return size[clk] == maxSize; }
     void update(int clk) { 
         cnt[!clk] = cnt[clk];
@@ -249,175 +393,348 @@ public:
         block[!clk] = block[clk];
         head[!clk] = head[clk];
         for (int i = 0; i < maxSize; ++i) que[!clk][i] = que[clk][i];
+        if (Cfg.physRegs) prf.update(clk);
+        fu.update(clk);
     }
     void clear(int clk) {
         for (int i = 0; i < maxSize; ++i) que[clk][i].busy = que[!clk][i].busy = 0;
         cnt[clk] = size[clk] = block[clk] = head[clk] = 0;
         cnt[!clk] = size[!clk] = block[!clk] = head[!clk] = 0;
+        fu.clear(clk);
+    }
+    // memory ordering: loads wait for older stores and atomics, stores and atomics for every older memory access
+    bool LSB_ready(int i, int clk) {
+        RSdata *a = &LSB->v[!clk][i];
+        if (a->qj != -1 || a->qk != -1) return false;
+        int h = a->dest;
+        bool load = is_I(que[!clk][h].op);
+        for (int i = 0, k = head[!clk]; i < size[!clk] && k != h; ++i, k = (k + 1) % maxSize) 
+            if (is_S(que[!clk][k].op) || is_A(que[!clk][k].op) || (!load && que[!clk][k].op >= 10 && que[!clk][k].op <= 14)) return false;
+        return true;
     }
-    void LSB_excute(int clk) {
-        RSdata *a = nullptr;
-        RoBdata *b = nullptr;
-        for (int i = 0; i < maxSize; ++i) {
-            if (!LSB->c[!clk][i] || LSB->v[!clk][i].qj != -1 || LSB->v[!clk][i].qk != -1) continue;
-            
-            a = &LSB->v[clk][i];
-            int flag = 0, h = a->dest;
-            b = &que[clk][h];
-            if (is_I(b->op)) {
-                for (int i = 0, k = head[!clk]; i < size[!clk] && k != h; ++i, k = (k + 1) % maxSize) 
-                    if (k ^ h && is_S(que[!clk][k].op)) { flag = 1; break; }
-            }
-            else {
-                for (int i = 0, k = head[!clk]; i < size[!clk] && k != h; ++i, k = (k + 1) % maxSize) 
-                    if (k ^ h && (is_S(que[!clk][k].op) || (que[!clk][k].op >= 10 && que[!clk][k].op <= 14))) { flag = 1; break; }
+    void LSB_finish(int i, int clk) {
+        RSdata *a = &LSB->v[clk][i];
+        RoBdata *b = &que[clk][a->dest];
+        b->busy = 0;
+        if (is_S(b->op)) {
+            b->dest = a->vj + a->A;
+            b->value = a->vk;
+        }
+        else if (is_A(b->op)) { // performed at commit, nothing to broadcast yet
+            b->addr = a->vj;
+            b->value = a->vk;
+            b->busy = 2;
+            LSB->c[clk][i] = 0; --LSB->size[clk];
+            return;
+        }
+        else {
+            b->value = A.run_I(a->op, a->vj, a->A);
+        }
+        LSB->c[clk][i] = 0; --LSB->size[clk];
+        publish(a->dest, b->value, clk);
+    }
+    // A result on the bus, tagged by its RoB entry, or by its physical register when renaming.
+    void publish(int id, int x, int clk) {
+        int tag = id;
+        if (Cfg.physRegs) {
+            if ((tag = que[clk][id].preg) < 0) return;
+            prf.v[tag] = x; prf.ready[clk][tag] = true;
+        }
+        LSB->bus(tag, x, clk);
+        RS->bus(tag, x, clk);
+    }
+    void RS_finish(int i, int clk) {
+        RSdata *a = &RS->v[clk][i];
+        RoBdata *b = &que[clk][a->dest];
+        b->busy = 0;                    
+        if (a->fop >= 0) { // a fused pair: the second half works on the first half's result
+            unsigned x = is_R(a->op) ? A.run_R(a->op, a->vj, a->vk) : A.run_I(a->op, a->vj, a->A);
+            b->first = x;
+            if (is_B(a->fop)) b->value ^= A.run_B(a->fop, x, 0);
+            else b->value = A.run_I(a->fop, x, a->fA);
+        }
+        else if (is_R(a->op)) { if (b->dest) b->value = A.run_R(a->op, a->vj, a->vk); }
+        else if (is_U(a->op)) { if (b->dest) b->value = A.run_U(a->op, a->A); }
+        else if (is_I(a->op)) {
+            if (a->op == 3) { reg->pc[clk] = (a->vj + a->A) & ~1; }
+            else { if (b->dest) b->value = A.run_I(a->op, a->vj, a->A); }
+        }
+        else if (is_B(a->op)) { b->value ^= A.run_B(a->op, a->vj, a->vk); }
+        RS->c[clk][i] = 0; --RS->size[clk];
+        publish(a->dest, b->result(), clk);
+        if (is_B(b->op) && (b->value & 1)) recover(a->dest, clk);
+    }
+    // A branch found mispredicted: everything younger is squashed, the rename map goes
+    // back to the branch's snapshot and fetch restarts on the other path. Commit may
+    // retire older entries in the same cycle, so snapshot tags are kept only for
+    // entries still between the head and the branch. Physical registers stay mapped
+    // until the next writer commits, and those of squashed entries go back on the free list.
+    void recover(int d, int clk) {
+        int n = (cnt[clk] - d + maxSize - 1) % maxSize + 1; // the branch and everything after it
+        auto young = [&](int k) { int j = (k - d + maxSize) % maxSize; return j && j < n; };
+        for (int i = 0; i < RS->maxSize; ++i) if (RS->c[clk][i] && young(RS->v[clk][i].dest)) RS->c[clk][i] = 0, --RS->size[clk];
+        for (int i = 0; i < LSB->maxSize; ++i) if (LSB->c[clk][i] && young(LSB->v[clk][i].dest)) LSB->c[clk][i] = 0, --LSB->size[clk];
+        cnt[clk] = (d + 1) % maxSize;
+        size[clk] -= n - 1;
+        block[clk] = 0; // only the youngest entry can hold fetch, and it is gone
+        if (Cfg.physRegs) {
+            for (int j = 1; j < n; ++j) if (que[clk][(d + j) % maxSize].preg >= 0) prf.release(que[clk][(d + j) % maxSize].preg, clk);
+            std::copy(snap[d], snap[d] + 32, reg->q[clk]);
+        }
+        else {
+            int live = (d - head[clk] + maxSize) % maxSize;
+            for (int r = 0; r < 32; ++r) {
+                int k = snap[d][r];
+                reg->q[clk][r] = k >= 0 && (k - head[clk] + maxSize) % maxSize <= live ? k : -1;
             }
-            if (flag) continue;
-
-            if (LSB->c[clk][i] < 3) { ++LSB->c[clk][i]; continue; }
-
-            b->busy = 0;
-            if (is_S(b->op)) {
-                b->dest = a->vj + sext(a->A, 12);
-                b->value = a->vk;
+        }
+        reg->pc[clk] = que[clk][d].dest;
+        ++recoveries; squashed += n - 1;
+        recovered = true;
+    }
+    // One execute stage for RS and LSB so that unit selection and writeback arbitration
+    // are both oldest-first and do not depend on the order the stages run in.
+    // c[] of an entry: 1 while waiting to start, then 1 + cycles spent in its unit.
+    // false if a branch recovered, for the front end to drop what it holds
+    bool excute(int clk) {
+        struct slot { int age, i; bool lsb; };
+        const static int maxSlot = 2 * maxSize;
+        slot ready[FUnum][maxSlot], done[maxSlot];
+        int n[FUnum] = {}, nd = 0;
+        auto push = [](slot *s, int &n, slot x) {
+            int j = n++;
+            for (; j && s[j - 1].age > x.age; --j) s[j] = s[j - 1];
+            s[j] = x;
+        };
+        auto visit = [&](RSbase *r, int i, bool lsb) {
+            int c = r->c[!clk][i];
+            if (!c) return;
+            RSdata *a = &r->v[!clk][i];
+            slot s = {(a->dest - head[!clk] + maxSize) % maxSize, i, lsb};
+            int lat = Cfg.fu[fu_class(a->op)].latency;
+            if (c == 1) {
+                if (lsb ? LSB_ready(i, clk) : a->qj == -1 && a->qk == -1) push(ready[fu_class(a->op)], n[fu_class(a->op)], s);
+                return;
             }
-            else {
-                b->value = A.run_I(a->op, a->vj, a->A);
+            if (c - 1 < lat) r->c[clk][i] = ++c;
+            if (c - 1 >= lat) push(done, nd, s);
+        };
+        fu.tick(clk);
+        for (int i = 0; i < RS->maxSize; ++i) visit(RS, i, false);
+        for (int i = 0; i < LSB->maxSize; ++i) visit(LSB, i, true);
+        for (int k = 0; k < FUnum; ++k) {
+            for (int j = 0; j < n[k]; ++j) {
+                if (!fu.start(k, clk)) { fu.waitUnit[k] += n[k] - j; break; }
+                RSbase *r = ready[k][j].lsb ? (RSbase *)LSB : (RSbase *)RS;
+                r->c[clk][ready[k][j].i] = 2;
+                if (1 >= Cfg.fu[k].latency) push(done, nd, ready[k][j]);
             }
-            LSB->c[clk][i] = 0; --LSB->size[clk];
-            LSB->bus(a->dest, b->value, clk);
-            RS->bus(a->dest, b->value, clk);
-        }
-    }
-    void RS_excute(int clk) {
-        RSdata *a = nullptr;
-        RoBdata *b = nullptr;
-        for (int i = 0; i < maxSize; ++i) {            
-            if (!RS->c[!clk][i] || RS->v[!clk][i].qj != -1 || RS->v[!clk][i].qk != -1) continue;
-            a = &RS->v[clk][i];
-            b = &que[clk][a->dest];
-            b->busy = 0;                    
-            if (is_R(a->op)) { if (b->dest) b->value = A.run_R(a->op, a->vj, a->vk); }
-            else if (is_U(a->op)) { if (b->dest) b->value = A.run_U(a->op, a->A); }
-            else if (is_I(a->op)) {
-                if (a->op == 3) { reg->pc[clk] = (a->vj + sext(a->A, 12)) & ~1; }
-                else { if (b->dest) b->value = A.run_I(a->op, a->vj, a->A); }
+        }
+        int ports = Cfg.wbPorts;
+        recovered = false;
+        for (int j = 0; j < nd; ++j) {
+            RSbase *r = done[j].lsb ? (RSbase *)LSB : (RSbase *)RS;
+            if (!r->c[clk][done[j].i]) continue; // squashed by an older branch
+            int op = r->v[!clk][done[j].i].op;
+            if (!is_S(op) && !is_B(op) && !is_A(op)) { // stores, branches and atomics do not drive a result here
+                if (!ports) { ++fu.waitPort; continue; }
+                --ports;
             }
-            else if (is_B(a->op)) { b->value ^= A.run_B(a->op, a->vj, a->vk); }
-            RS->c[clk][i] = 0; --RS->size[clk];
-            LSB->bus(a->dest, b->value, clk);
-            RS->bus(a->dest, b->value, clk);
+            if (done[j].lsb) LSB_finish(done[j].i, clk);
+            else RS_finish(done[j].i, clk);
         }
+        return !recovered;
+    }
+    // Between cycles, both halves equal: how many coming cycles execute and commit would
+    // spend only counting down, every RS and LSB entry waiting on an operand (or older
+    // memory accesses) or short of its latency and the head still executing. 0 if none.
+    int idle(int clk) {
+        if (size[clk] && que[clk][head[clk]].busy != 1) return 0;
+        int n = INT_MAX;
+        auto visit = [&](RSbase *r, int i, bool lsb) {
+            int c = r->c[clk][i];
+            if (!c) return;
+            RSdata *a = &r->v[clk][i];
+            if (c == 1) { if (lsb ? LSB_ready(i, clk) : a->qj == -1 && a->qk == -1) n = 0; }
+            else n = std::min(n, Cfg.fu[fu_class(a->op)].latency - c);
+        };
+        for (int i = 0; i < RS->maxSize; ++i) visit(RS, i, false);
+        for (int i = 0; i < LSB->maxSize; ++i) visit(LSB, i, true);
+        return n == INT_MAX ? 0 : std::max(n, 0);
+    }
+    void advance(int n, int clk) {
+        for (RSbase *r : {(RSbase *)RS, (RSbase *)LSB})
+            for (int i = 0; i < RSbase::maxSize; ++i) if (r->c[clk][i] > 1) r->c[0][i] = r->c[1][i] = r->c[clk][i] + n;
+        fu.advance(n);
+        now += n;
+        occupancy += (long long)size[clk] * n;
+        if (Cfg.physRegs) prf.used += (long long)prf.inUse(clk) * n;
+        if (prof) prof->cycle(!size[clk], que[clk][head[clk]].pc, n);
     }
     bool commit(int clk) { //clk: next time;
         // std::cerr << "head= " << head[clk] << ' ' << que[clk][head[clk]].busy <<'\n';
-        if (!size[!clk] || que[!clk][head[!clk]].busy) return true;
+        ++now;
+        occupancy += size[!clk];
+        if (Cfg.physRegs) prf.used += prf.inUse(!clk);
+        if (prof) prof->cycle(!size[!clk], que[!clk][head[!clk]].pc);
+        if (!size[!clk] || que[!clk][head[!clk]].busy == 1) return true;
         RoBdata *v = &que[clk][head[clk]]; 
         ++head[clk]; head[clk] %= maxSize;
         --size[clk];
         v->busy = 0;
+        if (is_A(v->op)) { // the only point where this hart touches memory other harts can see atomically
+            if (const char *f = Memory::atomic_fault(v->addr)) { // retiring, so on the real path
+                io->flush();
+                std::cerr << f << " to " << std::hex << v->addr << " at pc " << v->pc << std::dec << '\n';
+                exit(1);
+            }
+            if (v->op == 45) v->value = m->load_reserved(hart, v->addr);
+            else if (v->op == 46) v->value = !m->store_conditional(hart, v->addr, v->value);
+            else { int op = v->op; unsigned y = v->value; v->value = m->amo(v->addr, [=](unsigned x) { return ALU::run_A(op, x, y); }); }
+        }
+        else if (v->op == 56) { // ecall: everything older has retired and decode has waited for it
+            v->value = io->call(m, reg->x[clk], now);
+            exited = reg->x[clk][17] == HostIO::kExit;
+            reg->pc[clk] = v->pc + 4;
+            block[clk] = 0;
+        }
+        else if (v->op == 78) { // fence.i: every older store is in memory, so fetch starts over from it
+            reg->pc[clk] = v->pc + 4;
+            block[clk] = 0;
+        }
+        auto out = [&](const RoBdata &d) {
+            ++retired;
+            if (retire) retire(d);
+            if (prof) prof->retire(d.op, d.dest, d.pc);
+        };
+        if (v->fused >= 0) { // both halves retire, each as if it ran alone
+            RoBdata h(v->id, 0, v->first, v->fused, v->pc), t = *v;
+            h.dest = v->rd1;
+            t.pc += v->len1; t.fused = -1;
+            out(h); out(t);
+        }
+        else out(*v);
+        auto write = [&](int rd, int x) {
+            if (rd) reg->x[clk][rd] = x;
+            if (Cfg.physRegs) { // published again for results made at commit, atomics and ecall
+                if (v->preg >= 0) publish(v->id, x, clk), prf.release(v->old, clk);
+                return;
+            }
+            if (reg->q[clk][rd] == v->id) reg->q[clk][rd] = -1;
+            RS->bus(v->id, x, clk);
+            LSB->bus(v->id, x, clk);
+        };
+        if (v->fused >= 0 && is_B(v->op)) write(v->rd1, v->first); // the compare of a fused branch
 
         // std::cerr << funcs[v->op] << '\n';
 
-        if (v->op == 3) block[clk] = 0;
-        if (is_B(v->op)) {
-            if (v->value & 1) {
-                p.result(v->value & (~1), 0);
-                reg->pc[clk] = v->dest;
-                clear(clk);
-                RS->clear(clk);
-                LSB->clear(clk);
-                reg->clear(clk);
-                Bus *b = &Bus_; b->set(clk);
-                return false;
-            }
-            else {
-                p.result(v->value & (~1), 1);
-            }
-        }
+        if (v->op == 3 && v->fused < 0) block[clk] = 0; // a fused call never blocked
+        if (is_B(v->op)) p.result(v->value & (~1), !(v->value & 1)); // a misprediction was recovered in execute
         else if (is_S(v->op)) {
-            if (v->op == 15) m->store(v->dest, v->value, 1);
-            else if (v->op == 16) m->store(v->dest, v->value, 2);
-            else if (v->op == 17) m->store(v->dest, v->value, 4);
-        }
-        else { 
-            if (v->dest) reg->x[clk][v->dest] = v->value; 
-            if (reg->q[clk][v->dest] == v->id) reg->q[clk][v->dest] = -1;
-            RS->bus(v->id, v->value, clk);
-            LSB->bus(v->id, v->value, clk);
+            if (v->op == 15) m->store8(v->dest, v->value);
+            else if (v->op == 16) m->store16(v->dest, v->value);
+            else if (v->op == 17) m->store32(v->dest, v->value);
         }
+        else write(v->dest, v->value);
         //reg->print(clk);
         return true;
     }
 };
 
-extern ReorderBuffer RoB_;
-
 class decoder {
 private:
-    ReorderBuffer *RoB = &RoB_;
-    ReservationStation *RS = &RS_;
-    LoadStoreBuffer *LSB = &LSB_;
-    Register *reg = &Reg;
+    ReorderBuffer *RoB;
+    ReservationStation *RS;
+    LoadStoreBuffer *LSB;
+    Register *reg;
 public:
-    shared_ptr<instruction> decode(unsigned int ins) {
-        shared_ptr<instruction> o;
-        uint8_t opcode = ins & 0x7f;
-        if (opcode == 0x37 ||opcode == 0x17) { o = make_shared<U_type>(ins); }
-        else if (opcode == 0x6f) { o = make_shared<J_type>(ins); }
-        else if (opcode == 0x63) { o = make_shared<B_type>(ins); }
-        else if (opcode == 0x67 || opcode == 0x03 || opcode == 0x13) { o = make_shared<I_type>(ins); }
-        else if (opcode == 0x23) { o = make_shared<S_type>(ins); }
-        else if (opcode == 0x33) { o = make_shared<R_type>(ins); }
-        return o;
-    }
-    bool issue(shared_ptr<instruction> o, int pc, int clk) { //clk: next time
-        if (RoB->full(!clk)) return false;
-        int op = (o->op >= 10 && o->op <= 17);
-        if (op && LSB->full(!clk)) return false;
-        if (!op && RS->full(!clk)) return false;
+    decoder(ReorderBuffer *RoB_ = nullptr, ReservationStation *RS_ = nullptr, LoadStoreBuffer *LSB_ = nullptr, Register *reg_ = nullptr): RoB(RoB_), RS(RS_), LSB(LSB_), reg(reg_) {}
+    MicroOp decode(unsigned int ins) { return hst::decode(ins); }
+    // the entry being issued becomes the newest writer of rd
+    void rename(int rd, int clk) {
+        RoBdata *e = &RoB->que[clk][RoB->cnt[clk]];
+        if (!Cfg.physRegs) { reg->q[clk][rd] = RoB->cnt[clk]; return; }
+        if (!rd) return;
+        e->old = reg->q[clk][rd];
+        reg->q[clk][rd] = e->preg = RoB->prf.alloc(clk);
+    }
+    // an operand's value if it is ready, else the tag of the result it waits for;
+    // a result written back this cycle is bypassed, as bus does if it runs after issue
+    void operand(int r, int &x, int &tag, int clk) {
+        int h = reg->q[!clk][r];
+        tag = -1;
+        if (!r) x = 0;
+        else if (Cfg.physRegs) { if (RoB->prf.ready[!clk][h] || RoB->prf.ready[clk][h]) x = RoB->prf.v[h]; else tag = h; }
+        else if (h == -1) x = reg->x[!clk][r];
+        else if (!RoB->que[!clk][h].busy) x = RoB->que[!clk][h].result();
+        else if (!RoB->que[clk][h].busy) x = RoB->que[clk][h].result();
+        else tag = h;
+    }
+    // A fused pair takes one RoB and one RS entry. The first half has all the operands and
+    // sets up v; the second reads only its result and, but for a branch, overwrites it.
+    void fuse(const MicroOp &o, const MicroOp &t, unsigned pc, bool taken, RSdata *v, int clk) {
+        RoBdata *e = &RoB->que[clk][RoB->cnt[clk]];
+        unsigned tpc = pc + o.len;
+        e->fused = o.op; e->rd1 = o.rd; e->len1 = o.len; e->op = t.op;
+        if (o.op == 0) { e->first = o.imm; v->A += t.imm; } // lui+addi: one constant
+        else if (o.op == 1) { e->first = v->A; e->value = tpc + t.len; v->op = 2; } // auipc+jalr: a call decode has redirected
+        else if (t.is_B()) { v->fop = t.op; e->value = taken | tpc; e->dest = tpc + (taken ? t.len : t.imm); }
+        else { v->fop = t.op; v->fA = t.imm; }
+    }
+    // why o cannot issue: 1 no RoB, RS or LSB entry, 2 no free physical register; 0 if it can
+    int stall(const MicroOp &o, int clk) {
+        if (RoB->full(!clk)) return 1;
+        if (o.fu == kAGU ? LSB->full(!clk) : RS->full(!clk)) return 1;
+        if (Cfg.physRegs && o.writes() && o.rd && RoB->prf.empty(clk)) return 2;
+        return 0;
+    }
+    // taken: the direction fetch predicted for a branch, the second half's if t is fused in
+    bool issue(const MicroOp &o, unsigned pc, bool taken, int clk, const MicroOp *t = nullptr) { //clk: next time
+        if (int s = stall(o, clk)) { RoB->prf.stalls += s == 2; return false; }
+        int op = o.fu == kAGU;
         ++RoB->size[clk];
-        RoB->que[clk][RoB->cnt[clk]] = (RoBdata(RoB->cnt[clk], 1, 0, o->op));
+        RoB->que[clk][RoB->cnt[clk]] = (RoBdata(RoB->cnt[clk], 1, 0, o.op, pc));
+        if (o.op == 56 || o.op == 78) { // ecall and fence.i run at commit, with fetch held until then
+            RoB->que[clk][RoB->cnt[clk]].busy = 2;
+            if (o.op == 56) RoB->que[clk][RoB->cnt[clk]].dest = 10, rename(10, clk);
+            RoB->block[clk] = 1;
+            ++RoB->cnt[clk]; RoB->cnt[clk] %= RoB->maxSize;
+            return true;
+        }
         RSdata *v = nullptr;
         if (op) { for (int i = 0; i < LSB->maxSize; ++i) if (!LSB->c[!clk][i]) { v = &LSB->v[clk][i]; LSB->c[clk][i] = 1; LSB->add(clk); break; } }
         else { for (int i = 0; i < RS->maxSize; ++i) if (!RS->c[!clk][i]) { v = &RS->v[clk][i]; RS->c[clk][i] = 1; RS->add(clk); break; } }
         v->busy = 1; v->dest = RoB->cnt[clk];
-        v->A = o->get_imm(); v->op = o->op;
-        int rs1 = o->get_rs1(), rs2 = o->get_rs2(), rd = o->get_rd();
-        if (o->is_J()) { RoB->que[clk][RoB->cnt[clk]].value = pc + 4; }
-        else if (o->op == 3) { RoB->que[clk][RoB->cnt[clk]].value = pc + 4; RoB->block[clk] = 1; }
-        else if (o->op == 1) { v->A += pc; }    
+        v->A = o.imm; v->op = o.op; v->fop = -1;
+        int rs1 = o.rs1, rs2 = o.rs2, rd = o.rd;
+        if (o.is_J()) { RoB->que[clk][RoB->cnt[clk]].value = pc + o.len; }
+        else if (o.op == 3) { RoB->que[clk][RoB->cnt[clk]].value = pc + o.len; RoB->block[clk] = 1; }
+        else if (o.op == 1) { v->A += pc; }
         v->qj = v->qk = -1;
-        if (!(o->is_U() || o->is_J())) {
-            if (reg->q[!clk][rs1] != -1) {
-                int h = reg->q[!clk][rs1];
-                if (!RoB->que[!clk][h].busy) { v->vj = RoB->que[!clk][h].value; v->qj = -1; }
-                else v->qj = h;
-            }
-            else { v->vj = reg->x[!clk][rs1]; v->qj = -1; }
-            if (!rs1) { v->vj = 0; v->qj = -1; }
-        }
-        if (o->is_B() || o->is_S() || o->is_R()) {
-            if (reg->q[!clk][rs2] != -1) {
-                int h = reg->q[!clk][rs2];
-                if (!RoB->que[!clk][h].busy) { v->vk = RoB->que[!clk][h].value; v->qk = -1; }
-                else v->qk = h;
-            }
-            else { v->vk = reg->x[!clk][rs2]; v->qk = -1; }
-            if (!rs2) { v->vk = 0; v->qk = -1; }
-        }
-        if (o->is_B()) { RoB->que[clk][RoB->cnt[clk]].value = (pc & 1) | (reg->pc[!clk] - 4); RoB->que[clk][RoB->cnt[clk]].dest = pc & ~1; }
-        if (!(o->is_B() || o->is_S())) { reg->q[clk][rd] = RoB->cnt[clk]; RoB->que[clk][RoB->cnt[clk]].dest = rd; }
+        if (o.reads & 1) operand(rs1, v->vj, v->qj, clk);
+        if (o.reads & 2) operand(rs2, v->vk, v->qk, clk);
+        if (o.is_B()) { RoB->que[clk][RoB->cnt[clk]].value = taken | pc; RoB->que[clk][RoB->cnt[clk]].dest = pc + (taken ? o.len : o.imm); }
+        if (o.writes()) { rename(rd, clk); RoB->que[clk][RoB->cnt[clk]].dest = rd; }
+        if (t) fuse(o, *t, pc, taken, v, clk);
+        if (o.is_B() || (t && t->is_B())) std::copy(reg->q[clk], reg->q[clk] + 32, RoB->snap[RoB->cnt[clk]]);
         ++RoB->cnt[clk]; RoB->cnt[clk] %= RoB->maxSize;
         return true;
     }
 };
 
+// One hart: its own pipeline and registers over the shared Mem.
 class cabbage_cpu {
 private:
-    ALU a;
-    decoder d;
-    Memory *m = &Mem;
+    int hart;
+    Memory *m;
+    HostIO *io;
+    Register Reg;
+    ReservationStation RS_;
+    LoadStoreBuffer LSB_;
+    Bus Bus_;
+    ReorderBuffer RoB_{&RS_, &LSB_, &Reg, &Bus_, hart, m, io};
+    ALU a{m};
+    decoder d{&RoB_, &RS_, &LSB_, &Reg};
     Register *reg = &Reg;
     ReorderBuffer *RoB = &RoB_;
     ReservationStation *RS = &RS_;
@@ -425,84 +742,279 @@ private:
     Predictor *p = &(RoB_.p);
     Bus *b = &Bus_;
     int clock = 0, clk = clock & 1;
-    bool changeFlag[2], fetchFlag[2], pcFlag[2], break_;
-    unsigned ins[2], change[2], changepc[2];
-    std::function<void()> f[5];
+    bool break_ = false;
+    // Front end. Fetch fills the fetch queue with up to Cfg.fetchWidth predecoded
+    // instructions a cycle, predicting branches as it goes; decode issues one a cycle
+    // from its head and keeps it there while the back end is full.
+    struct FetchEntry { unsigned pc, raw; MicroOp o; bool taken; };
+    struct UopLine { unsigned pc, raw; MicroOp o; };
+    const static int maxQueue = 64, maxLoop = 64;
+    const static unsigned halt = 0x0ff00513;
+    FetchEntry fq[maxQueue];
+    long long fqHead[2] = {}, fqTail[2] = {};
+    bool wait[2] = {}; // fetch stopped at a jalr, ecall, fence.i, the halt word or an illegal instruction
+    bool hold[2] = {}; // fetch idles for the rest of a cycle that flushed
+    bool recover[2] = {}; // no instruction fetched since the last flush
+    unsigned fbuf[2][2] = {{~0u, ~0u}, {~0u, ~0u}}; // fetch blocks held in the fetch buffer
+    // direct mapped by pc; a line hits only if its raw bits still match memory, so code written by stores
+    // is decoded again. Fetch waits at a fence.i until it commits, so nothing younger was fetched before.
+    std::vector<UopLine> uop;
+    // loop buffer: the last instructions fetched in a straight line, and the loop being streamed
+    FetchEntry recent[maxLoop], lb[maxLoop];
+    int run = 0, lbSize = 0, lbPos = -1;
+    long long recentPos = 0;
+    long long fetchCount = 0, fetchCompressed = 0, fetchAccess = 0, fetchStraddle = 0;
+    long long uopHit = 0, uopMiss = 0, loops = 0, loopDelivered = 0, fqFull = 0, issueStall = 0;
+    long long starveFlush = 0, starveWait = 0, starveFetch = 0;
+    long long fusedPairs[4] = {};
+    long long skipped = 0;
+    std::function<void()> f[4];
     std::random_device rd;
 public:
+    cabbage_cpu(int hart_ = 0, Memory *m_ = &Mem, HostIO *io_ = &Host): hart(hart_), m(m_), io(io_) {}
     void clear(int clk) { 
-        fetchFlag[clk] = 0; fetchFlag[!clk] = 1;
-        ins[clk] = change[clk] = changepc[clk] = changeFlag[clk] = pcFlag[clk] = break_ = 0;
-        ins[!clk] = change[!clk] = changepc[!clk] = changeFlag[!clk] = pcFlag[!clk] = 0;
+        hold[clk] = false; hold[!clk] = true;
+        wait[clk] = wait[!clk] = false;
+        recover[clk] = recover[!clk] = true;
+        fqHead[clk] = fqHead[!clk] = fqTail[clk] = fqTail[!clk] = 0;
+        run = 0; lbPos = -1;
+        break_ = 0;
     }
     void update(int clk) { 
-        ins[!clk] = ins[clk]; 
-        change[!clk] = change[clk]; 
-        changeFlag[!clk] = changeFlag[clk]; 
-        fetchFlag[!clk] = fetchFlag[clk]; 
-        pcFlag[!clk] = pcFlag[clk];
-        changepc[!clk] = changepc[clk];
+        fqHead[!clk] = fqHead[clk]; fqTail[!clk] = fqTail[clk];
+        wait[!clk] = wait[clk]; hold[!clk] = hold[clk]; recover[!clk] = recover[clk];
+        fbuf[!clk][0] = fbuf[clk][0]; fbuf[!clk][1] = fbuf[clk][1];
         reg->update(clk);
         RoB->update(clk);
         RS->update(clk);
         LSB->update(clk);
         b->update(clk);
     }
-    void fetch(int clk) {
-        if (RoB->block[!clk] || break_) return ;
-        if (fetchFlag[!clk]) { ins[clk] = 0; /*fetchFlag[clk] = 0;*/ return; }
-        if (pcFlag[!clk]) reg->pc[!clk] = changepc[!clk], pcFlag[clk] = false;
-        ins[clk] = m->fetch(reg->pc[!clk]); 
-        reg->pc[clk] = reg->pc[!clk] + 4; 
-        fetchFlag[clk] = 0; 
+    bool buffered(int clk, unsigned blk) { return fbuf[clk][0] == blk || fbuf[clk][1] == blk; }
+    // A backward taken branch or jump closing a loop whose body was just fetched in a
+    // straight line: the body moves into the loop buffer, which then streams it.
+    void capture(unsigned target, unsigned pc) {
+        if (target >= pc) return;
+        for (int j = 1; j <= std::min(run, Cfg.loopBuffer); ++j) {
+            if (recent[(recentPos - j) % maxLoop].pc != target) continue;
+            for (int k = 0; k < j; ++k) lb[k] = recent[(recentPos - j + k) % maxLoop];
+            lbSize = j; lbPos = 0; ++loops;
+            return;
+        }
     }
-    bool issue(shared_ptr<instruction> o, int clk, bool res) {
-        if (!o->is_B()) return d.issue(o, reg->pc[!clk] - 4, clk);
-        else return d.issue(o, (reg->pc[!clk] - 4 + (res? 4 : sext(o->get_imm(), 13))) | res, clk);
+    // Instructions come from the loop buffer while it streams, else from the micro-op
+    // cache, else from memory through the fetch buffer: it keeps the last two fetch
+    // blocks and one block is read per cycle, so an instruction straddling into a block
+    // not yet read waits a cycle. A taken branch ends the cycle's fetch, except for the
+    // loop buffer going round.
+    void fetch(int clk) {
+        if (RoB->block[!clk] || wait[!clk] || hold[!clk] || break_) return;
+        unsigned pc = reg->pc[!clk];
+        bool read = false;
+        long long room = Cfg.fetchQueue - (fqTail[!clk] - fqHead[!clk]);
+        if (!room) ++fqFull;
+        for (int n = 0; n < Cfg.fetchWidth && n < room; ++n) {
+            FetchEntry e = {pc, 0, {}, false};
+            unsigned x = m->fetch(pc);
+            e.raw = ins_len(x) == 4 ? x : x & 0xffff;
+            bool looping = lbPos >= 0 && lb[lbPos].raw == e.raw;
+            if (lbPos >= 0 && !looping) lbPos = -1, run = 0; // the loop's code was overwritten
+            if (looping) e.o = lb[lbPos].o, ++loopDelivered;
+            else {
+                UopLine *l = uop.empty() ? nullptr : &uop[(pc >> 1) & (uop.size() - 1)];
+                if (l && l->pc == pc && l->raw == e.raw) e.o = l->o, ++uopHit;
+                else {
+                    int len = ins_len(x);
+                    unsigned first = pc / Cfg.fetchBlock, last = (pc + len - 1) / Cfg.fetchBlock;
+                    bool h0 = buffered(clk, first), h1 = buffered(clk, last);
+                    if (!h0 || !h1) {
+                        if (read) break;
+                        unsigned blk = h0 ? last : first;
+                        fbuf[clk][0] = blk == last && h0 ? first : fbuf[clk][1]; fbuf[clk][1] = blk;
+                        ++fetchAccess; read = true;
+                        if (!h0 && !h1 && first != last) { ++fetchStraddle; break; }
+                    }
+                    e.o = d.decode(e.raw);
+                    if (l) *l = {pc, e.raw, e.o};
+                    ++uopMiss;
+                }
+            }
+            unsigned next = pc + e.o.len;
+            bool taken = false, stop = e.raw == halt || !e.o.valid() || e.o.op == 3 || e.o.op == 56 || e.o.op == 78;
+            if (!e.o.valid()) next = pc;
+            else if (e.o.is_J()) next = pc + e.o.imm, taken = true;
+            else if (e.o.is_B() && (e.taken = p->predict(pc))) next = pc + e.o.imm, taken = true;
+            fq[fqTail[clk]++ % Cfg.fetchQueue] = e;
+            ++fetchCount; fetchCompressed += e.o.len == 2;
+            recover[clk] = false;
+            pc = next;
+            if (stop) { wait[clk] = true; run = 0; lbPos = -1; break; }
+            if (looping) {
+                if (taken && lbPos == lbSize - 1 && next == lb[0].pc) { lbPos = 0; continue; }
+                if (!taken && lbPos + 1 < lbSize) { ++lbPos; continue; }
+                lbPos = -1; run = 0; // left the loop
+                break;
+            }
+            recent[recentPos++ % maxLoop] = e; ++run;
+            if (taken) {
+                capture(next, e.pc);
+                run = 0;
+                if (lbPos < 0) break;
+            }
+        }
+        reg->pc[clk] = pc;
+    }
+    // Adjacent pairs decode fuses, by kind: lui+addi, auipc+jalr, slli+srli and a set-less-than
+    // with beqz/bnez on its result. The second half reads only the first's result, and
+    // overwrites it but in the branch, whose compare result stays live.
+    static int fusable(const MicroOp &h, const MicroOp &t) {
+        if (!h.rd || t.rs1 != h.rd) return -1;
+        if (h.op == 0 && t.op == 18 && t.rd == h.rd) return 0;
+        if (h.op == 1 && t.op == 3 && t.rd == h.rd) return 1;
+        if (h.op == 24 && t.op == 25 && t.rd == h.rd) return 2;
+        if ((h.op == 19 || h.op == 20 || h.op == 30 || h.op == 31) && (t.op == 4 || t.op == 5) && !t.rs2) return 3;
+        return -1;
     }
     bool decode(int clk) {
-        if (RoB->block[!clk] || break_) return false;
-        if (changeFlag[!clk]) ins[!clk] = change[!clk];
-        changeFlag[clk] = fetchFlag[clk] = pcFlag[clk] = false;
-        if (ins[!clk] == 0x0ff00513) return true;
-        if (!ins[!clk]) return false;    
-        shared_ptr<instruction> o = d.decode(ins[!clk]);
-        // o->print();
-        bool res = false;
-        if (o->is_B()) res = p->predict(reg->pc[!clk] - 4);
-        if(!issue(o, clk, res)) { reg->pc[clk] = reg->pc[!clk]; pcFlag[clk] = changeFlag[clk] = fetchFlag[clk] = fetchFlag[!clk] = true; change[clk] = ins[!clk]; return false; }
-        if (o->is_J()) { changepc[clk] = reg->pc[!clk] - 4 + sext(o->get_imm(), 21); change[clk] = 0; pcFlag[clk] = changeFlag[clk] = true; }
-        else if (o->is_B()) { changepc[clk] = reg->pc[!clk] - 4  + (res? sext(o->get_imm(), 13) : 4); change[clk] = 0; pcFlag[clk] = changeFlag[clk] = true; }
-        else if (o->op == 3) { change[clk] = 0; changeFlag[clk] = fetchFlag[clk] = true; }
-        // std::cout << "pcccc= " << reg->pc[clk] << '\n';
+        if (break_) return true;
+        if (fqHead[!clk] == fqTail[!clk]) {
+            if (recover[!clk]) ++starveFlush;
+            else if (RoB->block[!clk] || wait[!clk]) ++starveWait;
+            else ++starveFetch;
+            return false;
+        }
+        if (RoB->block[!clk]) return false;
+        const FetchEntry &e = fq[fqHead[!clk] % Cfg.fetchQueue];
+        if (e.raw == halt) return true;
+        if (!e.o.valid()) {
+            if (!RoB->size[!clk]) { // nothing older can redirect fetch, so this is on the real path
+                std::cerr << "illegal instruction " << std::hex << e.raw << " at pc " << e.pc << std::dec << '\n';
+                exit(1);
+            }
+            return false;
+        }
+        const FetchEntry *t = nullptr;
+        int kind = -1;
+        if (Cfg.fusion && fqHead[!clk] + 1 < fqTail[!clk]) {
+            t = &fq[(fqHead[!clk] + 1) % Cfg.fetchQueue];
+            if ((kind = fusable(e.o, t->o)) < 0) t = nullptr;
+        }
+        if (!d.issue(e.o, e.pc, t ? t->taken : e.taken, clk, t ? &t->o : nullptr)) { ++issueStall; return false; }
+        fqHead[clk] = fqHead[!clk] + 1 + !!t;
+        if (t) {
+            ++fusedPairs[kind];
+            if (t->o.op == 3) reg->pc[clk] = (e.pc + e.o.imm + t->o.imm) & ~1, wait[clk] = false; // fetch is idle, waiting on the jalr
+        }
+        else if (e.o.op == 3 || e.o.op == 56 || e.o.op == 78) wait[clk] = false; // the RoB holds fetch from here
+        if (e.o.op == 78) fbuf[clk][0] = fbuf[clk][1] = ~0u, run = 0, lbPos = -1; // refetched from memory after commit
         return false;
     }
+    void set_retire(std::function<void(const RoBdata &)> g) { RoB->retire = g; }
+    void set_profiler(Profiler *q) { RoB->prof = q; }
+    void dump() {
+        int c = clock & 1;
+        std::cerr << "  clock " << clock << " RoB head " << RoB->head[c] << " size " << RoB->size[c] << std::hex << '\n';
+        for (int i = 0, k = RoB->head[c]; i < RoB->size[c]; ++i, k = (k + 1) % RoB->maxSize) {
+            RoBdata *v = &RoB->que[c][k];
+            std::cerr << "    [" << std::dec << k << "] pc " << std::hex << v->pc << ' ' << funcs[v->op]
+                      << " busy " << v->busy << " dest " << v->dest << " value " << (unsigned)v->value << '\n';
+        }
+        std::cerr << "  pipeline registers:";
+        for (int i = 0; i < 32; ++i) std::cerr << (i % 8 ? " " : "\n    ") << reg->x[c][i];
+        std::cerr << std::dec << '\n';
+    }
     void init() {
         f[0] = [&]() ->void { fetch(clk); };
         f[1] = [&]() ->void { break_ = decode(clk); };
-        f[2] = [&]() ->void { RoB->RS_excute(clk); };
-        f[3] = [&]() ->void { RoB->LSB_excute(clk); };
-        f[4] = [&]() ->void { if (!RoB->commit(clk)) clear(clk), b->clear(clk); };
+        f[2] = [&]() ->void { if (!RoB->excute(clk)) clear(clk); };
+        f[3] = [&]() ->void { RoB->commit(clk); };
     }
-    void work() {
+    // a hart starts at pc 0 with a0 holding its hart id
+    void reset() {
         init();
-        m->init();
         reg->clear(0); reg->clear(1);
-        while (true) {
-            // break_ = decode(clk);
-            // fetch(clk);
-            // RoB->LSB_excute(clk);                         
-            // RoB->RS_excute(clk);
-            // if (!RoB->commit(clk)) clear(clk), b->clear(clk);            
-            std::shuffle(f, f + 5, rd);
-            for (int i = 0; i < 5; ++i) f[i]();
-            if (break_ && !RoB->size[clk]) break;
-            update(clk);
-            ++clock; clk ^= 1;
-        }
-        cout << std::dec << (((unsigned int)reg->x[clock & 1][10]) & 255u) << '\n';
+        clear(0); hold[1] = recover[0] = recover[1] = false;
+        uop.assign(Cfg.uopCache, UopLine{~0u, 0, {}});
+        reg->x[0][10] = reg->x[1][10] = hart;
+        if (Cfg.physRegs) RoB->prf.reset(reg->x[0], reg);
+    }
+    // resume from a checkpointed architectural state
+    void reset(unsigned pc, const unsigned *x) {
+        reset();
+        reg->pc[0] = reg->pc[1] = pc;
+        for (int i = 1; i < 32; ++i) reg->x[0][i] = reg->x[1][i] = x[i];
+        if (Cfg.physRegs) RoB->prf.reset(reg->x[0], reg);
+    }
+    // one cycle; false once the hart has halted
+    bool step() {
+        // break_ = decode(clk);
+        // fetch(clk);
+        // RoB->excute(clk);
+        // if (!RoB->commit(clk)) clear(clk), b->clear(clk);            
+        std::shuffle(f, f + 4, rd);
+        for (int i = 0; i < 4; ++i) f[i]();
+        if ((break_ || RoB->exited) && !RoB->size[clk]) return false;
+        update(clk);
+        ++clock; clk ^= 1;
+        return true;
+    }
+    // Jumps over coming cycles that provably change nothing but countdowns and counters:
+    // fetch and decode are stalled and the back end is idle by RoB::idle. The counters
+    // each of those cycles would have bumped are bumped, so the result is cycle exact.
+    // No further than cycle limit.
+    long long skip(long long limit = LLONG_MAX) {
+        if (!Cfg.skipIdle) return 0;
+        long long n = std::min<long long>(RoB->idle(clk), limit - clock);
+        if (n <= 0) return 0;
+        bool full = false, empty = false;
+        int stall = 0;
+        if (!(RoB->block[clk] || wait[clk] || hold[clk] || break_)) {
+            if (fqTail[clk] - fqHead[clk] < Cfg.fetchQueue) return 0;
+            full = true;
+        }
+        if (!break_) {
+            if (fqHead[clk] == fqTail[clk]) empty = true;
+            else if (!RoB->block[clk]) {
+                const FetchEntry &e = fq[fqHead[clk] % Cfg.fetchQueue];
+                if (e.raw == halt || (!e.o.valid() && !RoB->size[clk])) return 0;
+                if (e.o.valid() && !(stall = d.stall(e.o, clk))) return 0;
+            }
+        }
+        RoB->advance(n, clk);
+        fqFull += full * n;
+        if (empty) (recover[clk] ? starveFlush : RoB->block[clk] || wait[clk] ? starveWait : starveFetch) += n;
+        issueStall += (stall > 0) * n;
+        RoB->prf.stalls += (stall == 2) * n;
+        clock += n; clk = clock & 1;
+        skipped += n;
+        return n;
+    }
+    unsigned result() { return ((unsigned int)reg->x[clock & 1][10]) & 255u; }
+    bool exited() { return RoB->exited; } // by the exit call, with result() as its status
+    long long cycles() { return clock; }
+    void report() {
+        io->flush();
+        if (!exited()) cout << std::dec << result() << '\n';
         std::cerr << "clock: " << clock << '\n';
-        std::cerr << "predict sum: " << Predictor::sum << " \npredict success sum: " << Predictor::success << "\npercentage: " << (double)(1.0 * Predictor::success / Predictor::sum) << '\n';
+        std::cerr << "predict sum: " << p->sum << " \npredict success sum: " << p->success << "\npercentage: " << (double)(1.0 * p->success / p->sum) << '\n';
+        RoB->fu.print();
+        std::cerr << "mispredictions recovered in execute: " << RoB->recoveries << ", younger entries squashed: " << RoB->squashed << '\n';
+        std::cerr << "fetched: " << fetchCount << " (" << fetchCompressed << " compressed), fetch block reads: " << fetchAccess << ", straddle stalls: " << fetchStraddle << '\n';
+        std::cerr << "micro-op cache: " << uopHit << " hits, " << uopMiss << " misses; loop buffer: " << loops << " loops, " << loopDelivered << " instructions\n";
+        std::cerr << "fetch queue empty: " << starveFlush + starveWait + starveFetch << " cycles (" << starveFlush << " after a flush, " << starveWait
+                  << " waiting on jalr/ecall, " << starveFetch << " fetch limited), full: " << fqFull << " cycles, issue stalls: " << issueStall << '\n';
+        if (Cfg.physRegs) std::cerr << "physical registers: " << Cfg.physRegs << ", average in use " << (double)RoB->prf.used / std::max(1, clock)
+                                     << ", issue stalls on an empty free list: " << RoB->prf.stalls << '\n';
+        if (skipped) std::cerr << "idle cycles skipped: " << skipped << '\n';
+        std::cerr << "retired: " << RoB->retired << ", IPC " << (double)RoB->retired / std::max(1, clock) << ", average RoB occupancy " << (double)RoB->occupancy / std::max(1, clock) << '\n';
+        if (Cfg.fusion) std::cerr << "fused pairs: " << fusedPairs[0] + fusedPairs[1] + fusedPairs[2] + fusedPairs[3] << " (lui+addi " << fusedPairs[0]
+                                  << ", auipc+jalr " << fusedPairs[1] << ", slli+srli " << fusedPairs[2] << ", compare+branch " << fusedPairs[3] << ")\n";
+    }
+    void work() {
+        m->init();
+        reset();
+        while (step()) skip();
+        report();
     }
 };
 }
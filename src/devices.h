@@ -0,0 +1,49 @@
+#ifndef RISC_V_DEVICES_H
+#define RISC_V_DEVICES_H
+
+#include "memory.h"
+#include "hostio.h"
+#include <functional>
+
+namespace hst {
+
+// MMIO devices at the addresses of QEMU's virt machine, so bare-metal code for it runs unchanged.
+
+// 16550-style UART, transmit only: a byte stored to THR (offset 0) goes to stdout through
+// the host's output buffer; LSR (offset 5) always reads "transmitter empty".
+class Console: public Device {
+private:
+    HostIO *io;
+public:
+    const static unsigned int base = 0x10000000, size = 0x100;
+    Console(HostIO *io_ = &Host): io(io_) {}
+    unsigned int read(unsigned int off, int) override { return off == 5 ? 0x60 : 0; }
+    void write(unsigned int off, unsigned int x, int) override { if (!off) io->put(1, x & 0xff); }
+};
+
+// CLINT mtime: a read-only 64-bit count of the cycles of whoever drives it (instructions for a functional model)
+class Timer: public Device {
+private:
+    std::function<long long()> now;
+public:
+    const static unsigned int base = 0x0200bff8, size = 8;
+    Timer(std::function<long long()> now_): now(now_) {}
+    unsigned int read(unsigned int off, int n) override {
+        unsigned long long t = now() >> (off * 8);
+        return n == 4 ? (unsigned)t : t & ((1u << (n * 8)) - 1);
+    }
+    void write(unsigned int, unsigned int, int) override {}
+};
+
+struct Devices {
+    Console console;
+    Timer timer;
+    Devices(HostIO *io, std::function<long long()> now): console(io), timer(now) {}
+    void attach(Memory *m) {
+        m->map(Console::base, Console::size, &console);
+        m->map(Timer::base, Timer::size, &timer);
+    }
+};
+
+}
+#endif
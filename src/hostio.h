@@ -0,0 +1,89 @@
+#ifndef RISC_V_HOSTIO_H
+#define RISC_V_HOSTIO_H
+
+#include "memory.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+
+namespace hst {
+
+// Host side of the guest's ecalls, with the Linux RISC-V numbering: a7 selects
+// the call, a0-a2 carry the arguments and a0 the result (-errno on failure).
+// Output is gathered per stream and written in large blocks; input is served
+// from a buffer loaded before the run. One instance is shared by all harts.
+// Both engines use it.
+class HostIO {
+private:
+    const static size_t flushSize = 1 << 16;
+    std::string out[2]; // stdout, stderr
+    std::vector<unsigned char> in;
+    size_t inPos = 0;
+    unsigned brk = 0; // program break, the end of the image until the first brk call
+    std::mutex lock;
+    void flush(int f) {
+        if (!sink && !out[f].empty()) fwrite(out[f].data(), 1, out[f].size(), f ? stderr : stdout);
+        out[f].clear();
+    }
+public:
+    enum { kRead = 63, kWrite = 64, kExit = 93, kClock = 113, kBrk = 214 };
+    bool sink = false; // drop output, for sampled replays
+    ~HostIO() { flush(); }
+    bool load_input(const char *file) {
+        FILE *f = fopen(file, "rb");
+        if (!f) return false;
+        unsigned char buf[1 << 16];
+        for (size_t n; (n = fread(buf, 1, sizeof buf, f)) > 0; ) in.insert(in.end(), buf, buf + n);
+        fclose(f);
+        return true;
+    }
+    void set_input(std::vector<unsigned char> v) { in = std::move(v); inPos = 0; }
+    // input and break of another instance; output is not carried over
+    void copy(const HostIO &o) { in = o.in; inPos = o.inPos; brk = o.brk; }
+    void flush() { flush(0); flush(1); }
+    // one byte to stdout (fd 1) or stderr (fd 2), for the console device
+    void put(int fd, char c) {
+        std::lock_guard<std::mutex> g(lock);
+        out[fd - 1] += c;
+        if (out[fd - 1].size() >= flushSize) flush(fd - 1);
+    }
+    // x: the caller's registers; now: its cycle (or instruction) count for clock
+    unsigned call(Memory *m, const unsigned *x, long long now) {
+        std::lock_guard<std::mutex> g(lock);
+        unsigned a0 = x[10], a1 = x[11], a2 = x[12];
+        switch (x[17]) {
+            case kWrite: {
+                if (a0 != 1 && a0 != 2) return -9;
+                if (a2 > Memory::memSize) return -14;
+                std::string &s = out[a0 - 1];
+                size_t n = s.size();
+                s.resize(n + a2);
+                if (!m->read(a1, &s[n], a2)) { s.resize(n); return -14; }
+                if (s.size() >= flushSize) flush(a0 - 1);
+                return a2;
+            }
+            case kRead: {
+                if (a0) return -9;
+                unsigned n = std::min<size_t>(a2, in.size() - inPos);
+                if (!m->write(a1, in.data() + inPos, n)) return -14;
+                inPos += n;
+                return n;
+            }
+            case kBrk: {
+                if (!brk) brk = (m->end() + 15) & ~15u;
+                if (a0 >= m->end() && a0 < Memory::memSize) brk = a0;
+                return brk;
+            }
+            case kClock: return (unsigned)now;
+            case kExit: flush(); return a0;
+        }
+        return -38;
+    }
+};
+
+extern HostIO Host;
+
+}
+#endif
@@ -1,22 +1,103 @@
 #include "parser.h"
 #include "cpu.h"
 #include "memory.h"
+#include "checker.h"
+#include "multicore.h"
+#include "simpoint.h"
+#include "devices.h"
+#include "server.h"
 #include <bitset>
+#include <cstring>
+#include <algorithm>
+#include <bit>
 
 namespace hst {
+    Config Cfg;
     Memory Mem;
-    Register Reg;
-    Bus Bus_;
-    ReservationStation RS_;
-    LoadStoreBuffer LSB_;
-    ReorderBuffer RoB_;
-    int Predictor::sum = 0;
-    int Predictor::success = 0;
+    HostIO Host;
 }
 hst::cabbage_cpu T;
+hst::Checker C;
+hst::Profiler P;
+hst::Devices D(&hst::Host, [] { return T.cycles(); });
 
-int main() {
+int main(int argc, char **argv) {
+    bool check = false, profile = false;
+    const char *collapsed = nullptr, *symbols = nullptr;
+    const char *server = nullptr, *convert = nullptr;
+    int harts = 1, quantum = 1;
+    long long interval = 0, warmup = -1, inject = -1, maxCycles = 0;
+    int clusters = 8, samples = 2, jobs = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--check")) check = true;
+        else if (!strcmp(argv[i], "--input") && i + 1 < argc) {
+            if (!hst::Host.load_input(argv[++i])) { std::cerr << "cannot read " << argv[i] << '\n'; return 1; }
+        }
+        else if (!strcmp(argv[i], "--server") && i + 1 < argc) server = argv[++i];
+        else if (!strcmp(argv[i], "--convert") && i + 1 < argc) convert = argv[++i];
+        else if (!strcmp(argv[i], "--image") && i + 1 < argc) hst::Mem.set_image(argv[++i]);
+        else if (!strcmp(argv[i], "--inject") && i + 1 < argc) inject = strtoul(argv[++i], nullptr, 0);
+        else if (!strcmp(argv[i], "--max-cycles") && i + 1 < argc) maxCycles = std::max(0ll, atoll(argv[++i]));
+        else if (!strcmp(argv[i], "--profile")) profile = true;
+        else if (!strcmp(argv[i], "--collapsed") && i + 1 < argc) profile = true, collapsed = argv[++i];
+        else if (!strcmp(argv[i], "--symbols") && i + 1 < argc) symbols = argv[++i];
+        else if (!strcmp(argv[i], "--harts") && i + 1 < argc) harts = std::clamp(atoi(argv[++i]), 1, 64);
+        else if (!strcmp(argv[i], "--quantum") && i + 1 < argc) quantum = std::max(0, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--simpoint") && i + 1 < argc) interval = std::max(1ll, atoll(argv[++i]));
+        else if (!strcmp(argv[i], "--clusters") && i + 1 < argc) clusters = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--warmup") && i + 1 < argc) warmup = std::max(0ll, atoll(argv[++i]));
+        else if (!strcmp(argv[i], "--samples") && i + 1 < argc) samples = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--jobs") && i + 1 < argc) jobs = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--mul-latency") && i + 1 < argc) hst::Cfg.fu[hst::kMUL].latency = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--div-latency") && i + 1 < argc) hst::Cfg.fu[hst::kDIV].latency = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--fetch-block") && i + 1 < argc) hst::Cfg.fetchBlock = std::bit_floor(std::max(4u, (unsigned)atoi(argv[++i])));
+        else if (!strcmp(argv[i], "--fetch-width") && i + 1 < argc) hst::Cfg.fetchWidth = std::clamp(atoi(argv[++i]), 1, 16);
+        else if (!strcmp(argv[i], "--fetch-queue") && i + 1 < argc) hst::Cfg.fetchQueue = std::clamp(atoi(argv[++i]), 1, 64);
+        else if (!strcmp(argv[i], "--uop-cache") && i + 1 < argc) hst::Cfg.uopCache = std::bit_floor((unsigned)std::max(0, atoi(argv[++i])));
+        else if (!strcmp(argv[i], "--loop-buffer") && i + 1 < argc) hst::Cfg.loopBuffer = std::clamp(atoi(argv[++i]), 0, 64);
+        else if (!strcmp(argv[i], "--fuse")) hst::Cfg.fusion = true;
+        else if (!strcmp(argv[i], "--phys-regs") && i + 1 < argc) { int n = atoi(argv[++i]); hst::Cfg.physRegs = n ? std::clamp(n, 33, hst::PhysRegs::maxSize) : 0; }
+        else if (!strcmp(argv[i], "--no-skip")) hst::Cfg.skipIdle = false;
+        else if (!strcmp(argv[i], "--wb-ports") && i + 1 < argc) hst::Cfg.wbPorts = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--fu") && i + 4 < argc) { // --fu <class> <count> <latency> <pipelined>
+            int k = 0;
+            while (k < hst::FUnum && hst::FUnames[k] != argv[i + 1]) ++k;
+            if (k == hst::FUnum) { std::cerr << "unknown unit class " << argv[i + 1] << '\n'; return 1; }
+            hst::Cfg.fu[k] = {std::clamp(atoi(argv[i + 2]), 1, 8), std::max(1, atoi(argv[i + 3])), atoi(argv[i + 4]) != 0};
+            i += 4;
+        }
+    }
+    if (convert) {
+        hst::Mem.init();
+        if (!hst::Mem.save_image(convert)) { std::cerr << "cannot write " << convert << '\n'; return 1; }
+        return 0;
+    }
+    // sampling, several harts and the server run their own loops without the checker or the profiler
+    const char *mode = interval ? "--simpoint" : harts > 1 ? "--harts" : server ? "--server" : nullptr;
+    const char *other = check ? "--check" : profile ? "--profile" : interval && harts > 1 ? "--harts" : server && (interval || harts > 1) ? "--server" : nullptr;
+    if (mode && other) { std::cerr << other << " cannot be used with " << mode << '\n'; return 1; }
+    if (interval) {
+        return hst::SimPoint(interval, clusters, warmup < 0 ? interval : warmup, samples, jobs).work();
+    }
+    if (harts > 1) {
+        hst::multicore(harts, quantum).work();
+        return 0;
+    }
+    if (symbols && !P.load_symbols(symbols)) { std::cerr << "cannot read " << symbols << '\n'; return 1; }
+    D.attach(&hst::Mem);
+    if (server) return hst::ForkServer(server, inject, maxCycles, &T).work();
+    if (profile) T.set_profiler(&P);
+    if (check) T.set_retire([](const hst::RoBdata &v) {
+        if (C.step(v)) return;
+        C.dump(&v); T.dump();
+        exit(1);
+    });
     T.work();
+    if (profile) P.report(std::cerr, collapsed);
+    if (check) {
+        if (!C.finish()) { C.dump(nullptr); T.dump(); return 1; }
+        std::cerr << "check: " << C.count() << " instructions retired, no divergence\n";
+    }
     
-    return 0;
-}
\ No newline at end of file
+    return T.exited() ? T.result() : 0;
+}
@@ -2,13 +2,104 @@
 #define RISC_V_MEMORY_H
 #include <cstdio>
 #include <iostream>
+#include <atomic>
+#include <mutex>
+#include <cstring>
+#include <algorithm>
+#include <cstdint>
+#include <bit>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 namespace hst{
+
+// A device behind a range of guest addresses; off is relative to the start of the range.
+class Device {
+public:
+    virtual ~Device() = default;
+    virtual unsigned int read(unsigned int off, int n) = 0;
+    virtual void write(unsigned int off, unsigned int x, int n) = 0;
+};
+
 class Memory{
+public:
+    const static unsigned int memSize = 20000005;
+    const static int pageBits = 12;
+    const static unsigned int pageSize = 1u << pageBits, pages = (memSize + pageSize - 1) >> pageBits;
 private:
-    unsigned char mem[20000005];
+    alignas(4096) unsigned char mem[memSize]; // page aligned, so image pages can be mapped over it
+    unsigned int top = 0; // end of the loaded image
+    const char *imageFile = nullptr; // a binary image to map instead of the hex on stdin
+    // Binary image: header, the runs of non-zero pages, then the pages of each run
+    // contiguous, starting page aligned in the file. Host byte order.
+    struct ImageHeader { char magic[8]; uint32_t top, runs; };
+    struct ImageRun { uint32_t page, count; uint64_t offset; };
+    constexpr static char imageMagic[8] = {'R', 'V', 'I', 'M', 'A', 'G', 'E', '1'};
+    // LR/SC reservations, one word per hart; a store to a reserved word breaks them
+    const static int maxHarts = 64;
+    std::mutex reserveLock;
+    std::atomic<int> reserved{0};
+    unsigned int reserveAddr[maxHarts];
+    bool reserveValid[maxHarts] = {};
+    void invalidate(unsigned int place, int n) { // reserveLock held
+        for (int h = 0; h < maxHarts; ++h)
+            if (reserveValid[h] && place < reserveAddr[h] + 4 && reserveAddr[h] < place + n) reserveValid[h] = false, --reserved;
+    }
+    std::atomic_ref<unsigned int> word(unsigned int place) { return std::atomic_ref<unsigned int>(*(unsigned int *)(mem + place)); }
+    // MMIO regions, all above RAM; an access outside RAM and every region reads 0 and is dropped
+    struct Region { unsigned int base, size; Device *dev; };
+    const static int maxRegions = 8;
+    Region region[maxRegions] = {};
+    int regions = 0;
+    Device *find(unsigned int place, unsigned int &off) {
+        for (int i = 0; i < regions; ++i)
+            if (place - region[i].base < region[i].size) { off = place - region[i].base; return region[i].dev; }
+        return nullptr;
+    }
+    unsigned int load_io(unsigned int place, int n) {
+        unsigned int off;
+        Device *d = find(place, off);
+        return d ? d->read(off, n) : 0;
+    }
+    void store_io(unsigned int place, unsigned int x, int n) {
+        unsigned int off;
+        if (Device *d = find(place, off)) d->write(off, x, n);
+    }
+    // RAM first: one host access of the width, misaligned or not, in guest (little-endian) byte order
+    template<class T>
+    unsigned int load_as(unsigned int place) {
+        if (place > memSize - sizeof(T)) [[unlikely]] return load_io(place, sizeof(T));
+        T x;
+        std::memcpy(&x, mem + place, sizeof x);
+        if constexpr (std::endian::native == std::endian::big && sizeof(T) == 2) x = __builtin_bswap16(x);
+        if constexpr (std::endian::native == std::endian::big && sizeof(T) == 4) x = __builtin_bswap32(x);
+        return x;
+    }
+    template<class T>
+    void put(unsigned int place, unsigned int v) {
+        if (place > memSize - sizeof(T)) [[unlikely]] return store_io(place, v, sizeof(T));
+        T x = v;
+        if constexpr (std::endian::native == std::endian::big && sizeof(T) == 2) x = __builtin_bswap16(x);
+        if constexpr (std::endian::native == std::endian::big && sizeof(T) == 4) x = __builtin_bswap32(x);
+        std::memcpy(mem + place, &x, sizeof x);
+    }
+    template<class T>
+    void store_as(unsigned int place, unsigned int x) {
+        if (reserved.load(std::memory_order_relaxed)) [[unlikely]] {
+            std::lock_guard<std::mutex> g(reserveLock);
+            invalidate(place, sizeof(T));
+            return put<T>(place, x);
+        }
+        put<T>(place, x);
+    }
 public:
     void init() {
+        if (imageFile) {
+            if (!map_image(imageFile)) { std::cerr << "cannot load image " << imageFile << '\n'; exit(1); }
+            return;
+        }
         bool count = false;
         char c;
         unsigned int place = 0, x = 0;
@@ -22,25 +113,132 @@ public:
                     x = x * 16 + (c > '9'? 10 + c - 'A' : c - '0');
                     Memory::mem[place++] = x; x = 0;
                     count ^= 1;
+                    top = std::max(top, place);
                 }
                 else x = c > '9'? 10 + c - 'A' : c - '0', count ^= 1;
             }
         }
     }
-    unsigned int fetch(int place) {
-        unsigned int ins = 0;
-        for (int i = 0; i < 4; ++i) ins |= (Memory::mem[i + place] << (i * 8));
-        return ins;
+    unsigned int end() const { return top; }
+    void set_image(const char *file) { imageFile = file; }
+    // Pages are mapped private over mem, so the kernel reads each one in on its first
+    // access; startup and resident memory follow the working set, not the image size.
+    bool map_image(const char *file) {
+        int fd = open(file, O_RDONLY);
+        if (fd < 0) return false;
+        ImageHeader h;
+        std::vector<ImageRun> runs;
+        bool ok = pread(fd, &h, sizeof h, 0) == sizeof h && !std::memcmp(h.magic, imageMagic, 8) && h.top <= memSize;
+        if (ok) {
+            runs.resize(h.runs);
+            size_t n = runs.size() * sizeof(ImageRun);
+            ok = pread(fd, runs.data(), n, sizeof h) == (ssize_t)n;
+        }
+        // with other host page sizes, and for the partial last page of mem, pages are read instead
+        bool direct = sysconf(_SC_PAGESIZE) == pageSize;
+        const unsigned full = memSize >> pageBits;
+        for (size_t i = 0; ok && i < runs.size(); ++i) {
+            ImageRun r = runs[i];
+            if (r.page >= pages || r.count > pages - r.page) { ok = false; break; }
+            unsigned char *dst = mem + (r.page << pageBits);
+            unsigned whole = direct && r.page < full ? std::min(r.count, full - r.page) : 0;
+            if (whole && mmap(dst, (size_t)whole << pageBits, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, r.offset) == MAP_FAILED) whole = 0;
+            size_t rest = std::min<size_t>((size_t)r.count << pageBits, memSize - (r.page << pageBits)) - ((size_t)whole << pageBits);
+            if (rest && pread(fd, dst + ((size_t)whole << pageBits), rest, r.offset + ((uint64_t)whole << pageBits)) != (ssize_t)rest) ok = false;
+        }
+        close(fd);
+        if (ok) top = h.top;
+        return ok;
     }
-    unsigned int load(int place, int n) {
-        unsigned int x = 0;
-        //std::cout << "place= " << place << ' ' << n << '\n';
-        for (int i = 0; i < n; ++i) x |= mem[i + place] << (i * 8);
-        return x;
+    bool save_image(const char *file) const {
+        std::vector<ImageRun> runs;
+        for (unsigned p = 0; p < pages; ++p) {
+            const unsigned char *b = mem + (p << pageBits);
+            if (std::all_of(b, b + page_bytes(p), [](unsigned char c) { return !c; })) continue;
+            if (!runs.empty() && runs.back().page + runs.back().count == p) ++runs.back().count;
+            else runs.push_back({p, 1, 0});
+        }
+        uint64_t off = (sizeof(ImageHeader) + runs.size() * sizeof(ImageRun) + pageSize - 1) & ~(uint64_t)(pageSize - 1);
+        for (auto &r : runs) r.offset = off, off += (uint64_t)r.count << pageBits;
+        FILE *f = fopen(file, "wb");
+        if (!f) return false;
+        ImageHeader h = {{}, top, (uint32_t)runs.size()};
+        std::memcpy(h.magic, imageMagic, 8);
+        bool ok = fwrite(&h, sizeof h, 1, f) == 1 && fwrite(runs.data(), sizeof(ImageRun), runs.size(), f) == runs.size();
+        static const unsigned char zero[pageSize] = {};
+        for (auto &r : runs) {
+            ok = ok && !fseek(f, r.offset, SEEK_SET);
+            for (unsigned p = r.page; ok && p < r.page + r.count; ++p)
+                ok = fwrite(mem + (p << pageBits), 1, page_bytes(p), f) == page_bytes(p) && fwrite(zero, 1, pageSize - page_bytes(p), f) == pageSize - page_bytes(p);
+        }
+        return fclose(f) == 0 && ok;
+    }
+    // a device region at [base, base + size), outside RAM
+    void map(unsigned int base, unsigned int size, Device *d) { if (regions < maxRegions) region[regions++] = {base, size, d}; }
+    bool mapped(unsigned int place) { unsigned int off; return place >= memSize && find(place, off); }
+    unsigned int load8(unsigned int place) { return load_as<uint8_t>(place); }
+    unsigned int load16(unsigned int place) { return load_as<uint16_t>(place); }
+    unsigned int load32(unsigned int place) { return load_as<uint32_t>(place); }
+    void store8(unsigned int place, unsigned int x) { store_as<uint8_t>(place, x); }
+    void store16(unsigned int place, unsigned int x) { store_as<uint16_t>(place, x); }
+    void store32(unsigned int place, unsigned int x) { store_as<uint32_t>(place, x); }
+    unsigned int fetch(unsigned int place) { return load32(place); }
+    unsigned int load(unsigned int place, int n) { return n == 4 ? load32(place) : n == 2 ? load16(place) : load8(place); }
+    void store(unsigned int place, unsigned int x, int n) {
+        if (n == 4) store32(place, x);
+        else if (n == 2) store16(place, x);
+        else store8(place, x);
+    }
+    // RV32A on aligned words in RAM, atomic with respect to the other harts. Callers
+    // raise atomic_fault(place) as a guest fault; such an access leaves memory alone.
+    static const char *atomic_fault(unsigned int place) {
+        if (place & 3) return "misaligned atomic access";
+        if (place > memSize - 4) return "atomic access fault";
+        return nullptr;
+    }
+    unsigned int load_reserved(int hart, unsigned int place) {
+        if (atomic_fault(place)) return 0;
+        std::lock_guard<std::mutex> g(reserveLock);
+        if (!reserveValid[hart]) reserveValid[hart] = true, ++reserved;
+        reserveAddr[hart] = place;
+        return word(place).load();
+    }
+    bool store_conditional(int hart, unsigned int place, unsigned int x) {
+        if (atomic_fault(place)) return false;
+        std::lock_guard<std::mutex> g(reserveLock);
+        bool ok = reserveValid[hart] && reserveAddr[hart] == place;
+        if (reserveValid[hart]) reserveValid[hart] = false, --reserved;
+        if (!ok) return false;
+        invalidate(place, 4);
+        word(place).store(x);
+        return true;
+    }
+    template<class F>
+    unsigned int amo(unsigned int place, F f) { // f maps the old value to the new one
+        if (atomic_fault(place)) return 0;
+        std::atomic_ref<unsigned int> w = word(place);
+        if (reserved.load()) { std::lock_guard<std::mutex> g(reserveLock); invalidate(place, 4); }
+        unsigned int old = w.load();
+        while (!w.compare_exchange_weak(old, f(old)));
+        return old;
+    }
+    // whole images and single pages, for checkpoints; devices are not copied
+    void copy(const Memory &o) { std::memcpy(mem, o.mem, memSize); top = o.top; }
+    unsigned int page_bytes(unsigned int page) const { return std::min(pageSize, memSize - (page << pageBits)); }
+    void read_page(unsigned int page, unsigned char *dst) const { std::memcpy(dst, mem + (page << pageBits), page_bytes(page)); }
+    void write_page(unsigned int page, const unsigned char *src) { std::memcpy(mem + (page << pageBits), src, page_bytes(page)); }
+    bool same_page(const Memory &o, unsigned int page) const { return !std::memcmp(mem + (page << pageBits), o.mem + (page << pageBits), page_bytes(page)); }
+    // byte ranges for host calls; false if the range leaves memory
+    bool read(unsigned int place, void *dst, unsigned int n) const {
+        if (place > memSize || n > memSize - place) return false;
+        std::memcpy(dst, mem + place, n);
+        return true;
     }
-    void store(int place, unsigned int x, int n) {
-        //std::cerr << "store= " << place << ' ' << x << ' ' << n << '\n';
-        for (int i = 0; i < n; ++i) mem[i + place] = x & 0xff, x >>= 8;
+    bool write(unsigned int place, const void *src, unsigned int n) {
+        if (place > memSize || n > memSize - place) return false;
+        if (reserved.load()) { std::lock_guard<std::mutex> g(reserveLock); invalidate(place, n); }
+        std::memcpy(mem + place, src, n);
+        return true;
     }
 };
 
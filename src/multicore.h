@@ -0,0 +1,52 @@
+#ifndef RISC_V_MULTICORE_H
+#define RISC_V_MULTICORE_H
+
+#include "cpu.h"
+#include "memory.h"
+#include "devices.h"
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <barrier>
+#include <atomic>
+
+namespace hst {
+
+// N harts sharing Mem, each advanced on its own host thread.
+// quantum 1 keeps the harts in cycle lockstep, q > 1 lets each run q cycles between
+// barriers, 0 runs them free with only the atomics ordering their memory accesses.
+class multicore {
+private:
+    std::vector<std::unique_ptr<cabbage_cpu>> harts;
+    int quantum;
+    Memory *m = &Mem;
+    std::atomic<long long> clock{0}; // hart 0's cycle, published for the timer
+    Devices dev{&Host, [this] { return clock.load(std::memory_order_relaxed); }};
+public:
+    multicore(int n, int quantum_): quantum(quantum_) {
+        for (int i = 0; i < n; ++i) harts.push_back(std::make_unique<cabbage_cpu>(i));
+    }
+    void work() {
+        m->init();
+        dev.attach(m);
+        for (auto &h : harts) h->reset();
+        std::barrier sync((std::ptrdiff_t)harts.size());
+        std::vector<std::thread> threads;
+        for (auto &h : harts) threads.emplace_back([&, c = h.get()]() {
+            long long t = 0;
+            while (c->step()) {
+                if (c == harts[0].get()) clock.store(c->cycles(), std::memory_order_relaxed);
+                if (quantum && ++t % quantum == 0) sync.arrive_and_wait();
+            }
+            if (quantum) sync.arrive_and_drop(); // a halted hart no longer holds the others back
+        });
+        for (auto &t : threads) t.join();
+        harts[0]->report();
+        for (size_t i = 0; i < harts.size(); ++i)
+            std::cerr << "hart " << i << ": clock " << harts[i]->cycles() << ", a0 " << harts[i]->result() << '\n';
+    }
+};
+
+}
+#endif
@@ -6,6 +6,9 @@
 #include <cstring>
 #include <memory>
 #include <bitset>
+#include <array>
+#include <cstdint>
+#include <type_traits>
 using std::cout;
 using std::cin;
 using std::shared_ptr;
@@ -13,167 +16,253 @@ using std::string;
 using std::make_shared;
 
 namespace hst{
-static string funcs[38] = {"lui", "auipc", "jal", "jalr", "beq", "bne", "blt", "bge", "bltu", "bgeu", "lb", "lh", "lw", "lbu", "lhu", "sb", "sh", "sw", "addi", "slti", "sltiu", "xori", "ori", "andi", "slli", "srli", "srai", "add", "sub", "sll", "slt", "sltu", "xor", "srl", "sra", "or", "and" };
+const static int funcNum = 79;
+static string funcs[funcNum] = {"lui", "auipc", "jal", "jalr", "beq", "bne", "blt", "bge", "bltu", "bgeu", "lb", "lh", "lw", "lbu", "lhu", "sb", "sh", "sw", "addi", "slti", "sltiu", "xori", "ori", "andi", "slli", "srli", "srai", "add", "sub", "sll", "slt", "sltu", "xor", "srl", "sra", "or", "and", "mul", "mulh", "mulhsu", "mulhu", "div", "divu", "rem", "remu", "lr.w", "sc.w", "amoswap.w", "amoadd.w", "amoxor.w", "amoand.w", "amoor.w", "amomin.w", "amomax.w", "amominu.w", "amomaxu.w", "ecall",
+    "sh1add", "sh2add", "sh3add", "andn", "orn", "xnor", "min", "minu", "max", "maxu", "rol", "ror", "zext.h",
+    "clz", "ctz", "cpop", "sext.b", "sext.h", "orc.b", "rev8", "rori", "fence.i" };
 
 inline unsigned int get_num(unsigned int ins, int l, int r) {
     ins >>= l;
     return ins ^ ((ins >> (r - l + 1)) << (r - l + 1));
 }
 
-struct instruction {
-    unsigned int op : 6;
-    virtual unsigned int get_rd() = 0;
-    virtual unsigned int get_rs1() = 0;
-    virtual unsigned int get_rs2() = 0;
-    virtual unsigned int get_imm() = 0;
-    void print() { std::cerr << std::dec << funcs[op] << ' ' <<get_rs1() << ' ' << get_rs2() << ' ' << get_rd() << ' ' << get_imm() <<'\n'; }
-    bool is_R() { return op >= 27 && op <= 36; }
-    bool is_I() { return op == 3 || (op >= 10 && op <= 14) || (op >= 18 && op <= 26); }
-    bool is_S() { return op >= 15 && op <= 17; }
-    bool is_B() { return op >= 4 && op <= 9; }
-    bool is_U() { return op == 0 || op == 1; }
-    bool is_J() { return op == 2; }
-};
-struct R_type: public instruction {
-    unsigned int rs2 : 5;
-    unsigned int rs1 : 5;
-    unsigned int rd : 5;
-    unsigned int get_rd() override { return rd; }
-    unsigned int get_rs1() override { return rs1; }
-    unsigned int get_rs2() override { return rs2; }
-    unsigned int get_imm() override { return 0; }
-    R_type(unsigned int ins) {
-        unsigned int funct3 = (ins >> 12) & 0x7;
-        rs1 = (ins >> 15) & 0x1f;
-        rs2 = (ins >> 20) & 0x1f;
-        rd = (ins >> 7) & 0x1f;
-        if (funct3 == 0) {
-            if ((ins >> 30) ^ 1) op = 27;
-            else op = 28;
-        }
-        else if (funct3 == 1) op = 29;
-        else if (funct3 == 2) op = 30;
-        else if (funct3 == 3) op = 31;
-        else if (funct3 == 4) op = 32;
-        else if (funct3 == 5) {
-            if ((ins >> 30) ^ 1) op = 33;
-            else op = 34;
+inline signed int sext(unsigned int x, int n) { return (int)(x << (32 - n)) >> (32 - n); }
+
+// RV32A: op of an lr/sc/amo word instruction by funct5, -1 if it is not one
+inline int amo_op(unsigned int ins) {
+    static const int f[32] = {48, 47, 45, 46, 49, -1, -1, -1, 51, -1, -1, -1, 50, -1, -1, -1,
+                              52, -1, -1, -1, 53, -1, -1, -1, 54, -1, -1, -1, 55, -1, -1, -1};
+    return ((ins >> 12) & 0x7) == 2 ? f[ins >> 27] : -1;
+}
+
+// Zbb: op of a unary instruction, told apart by the whole immediate (rs2 for zext.h), -1 if it is not one
+inline int unary_op(unsigned int ins) {
+    unsigned f3 = (ins >> 12) & 0x7, imm = ins >> 20;
+    if ((ins & 0x7f) == 0x33) return f3 == 4 && imm == 0x080 ? 69 : -1;
+    static const int f[6] = {70, 71, 72, -1, 73, 74};
+    if (f3 == 1 && imm >= 0x600 && imm <= 0x605) return f[imm - 0x600];
+    if (f3 == 5 && imm == 0x287) return 75;
+    if (f3 == 5 && imm == 0x698) return 76;
+    return -1;
+}
+
+// RV32C: expand a 16-bit instruction into its 32-bit equivalent, 0 if it has none
+inline int ins_len(unsigned int ins) { return (ins & 3) == 3 ? 4 : 2; }
+
+namespace rvc {
+inline unsigned int I(int imm, unsigned rs1, unsigned f3, unsigned rd, unsigned opc) { return (imm & 0xfff) << 20 | rs1 << 15 | f3 << 12 | rd << 7 | opc; }
+inline unsigned int S(int imm, unsigned rs2, unsigned rs1, unsigned f3) { return ((imm >> 5) & 0x7f) << 25 | rs2 << 20 | rs1 << 15 | f3 << 12 | (imm & 0x1f) << 7 | 0x23; }
+inline unsigned int R(unsigned f7, unsigned rs2, unsigned rs1, unsigned f3, unsigned rd) { return f7 << 25 | rs2 << 20 | rs1 << 15 | f3 << 12 | rd << 7 | 0x33; }
+inline unsigned int B(int imm, unsigned rs1, unsigned f3) {
+    return ((imm >> 12) & 1) << 31 | ((imm >> 5) & 0x3f) << 25 | rs1 << 15 | f3 << 12 | ((imm >> 1) & 0xf) << 8 | ((imm >> 11) & 1) << 7 | 0x63;
+}
+inline unsigned int J(int imm, unsigned rd) {
+    return ((imm >> 20) & 1) << 31 | ((imm >> 1) & 0x3ff) << 21 | ((imm >> 11) & 1) << 20 | ((imm >> 12) & 0xff) << 12 | rd << 7 | 0x6f;
+}
+inline int j_imm(unsigned int c) {
+    return sext(get_num(c, 12, 12) << 11 | get_num(c, 11, 11) << 4 | get_num(c, 9, 10) << 8 | get_num(c, 8, 8) << 10
+            | get_num(c, 7, 7) << 6 | get_num(c, 6, 6) << 7 | get_num(c, 3, 5) << 1 | get_num(c, 2, 2) << 5, 12);
+}
+inline int b_imm(unsigned int c) {
+    return sext(get_num(c, 12, 12) << 8 | get_num(c, 10, 11) << 3 | get_num(c, 5, 6) << 6 | get_num(c, 3, 4) << 1 | get_num(c, 2, 2) << 5, 9);
+}
+}
+
+inline unsigned int expand(unsigned int c) {
+    using namespace rvc;
+    unsigned int f3 = get_num(c, 13, 15), rd = get_num(c, 7, 11), rs2 = get_num(c, 2, 6);
+    unsigned int rdp = get_num(c, 2, 4) + 8, rs1p = get_num(c, 7, 9) + 8;
+    int imm6 = sext(get_num(c, 12, 12) << 5 | rs2, 6);
+    switch (c & 3) {
+        case 0: {
+            if (f3 == 0) {
+                unsigned int imm = get_num(c, 11, 12) << 4 | get_num(c, 7, 10) << 6 | get_num(c, 6, 6) << 2 | get_num(c, 5, 5) << 3;
+                return imm ? I(imm, 2, 0, rdp, 0x13) : 0;
+            }
+            unsigned int imm = get_num(c, 10, 12) << 3 | get_num(c, 6, 6) << 2 | get_num(c, 5, 5) << 6;
+            if (f3 == 2) return I(imm, rs1p, 2, rdp, 0x03);
+            if (f3 == 6) return S(imm, rdp, rs1p, 2);
+            return 0;
         }
-        else if (funct3 == 6) op = 35;
-        else if (funct3 == 7) op = 36;
-    }
-};
-struct I_type: public instruction {
-    unsigned int imm :12;
-    unsigned int rs1 : 5;
-    unsigned int rd : 5;
-    unsigned int get_rd() override { return rd; }
-    unsigned int get_rs1() override { return rs1; }
-    unsigned int get_rs2() override { return 0; }
-    unsigned int get_imm() override { return imm; }
-    I_type(unsigned int ins) {
-        unsigned int opcode = ins & 0x7f;
-        unsigned int funct3 = (ins >> 12) & 0x7;
-        rd = (ins >> 7) & 0x1f;
-        rs1 = (ins >> 15) & 0x1f;
-        imm = (ins >> 20) & 0xfff;
-        if (opcode == 0x67) { op = 3; }
-        else if (opcode == 0x03) {
-            if (funct3 == 0) op = 10;
-            else if (funct3 == 1) op = 11;
-            else if (funct3 == 2) op = 12;
-            else if (funct3 == 4) op = 13;
-            else if (funct3 == 5) op = 14;
+        case 1: {
+            switch (f3) {
+                case 0: return I(imm6, rd, 0, rd, 0x13);
+                case 1: return J(j_imm(c), 1);
+                case 2: return I(imm6, 0, 0, rd, 0x13);
+                case 3: {
+                    if (rd == 2) {
+                        int imm = sext(get_num(c, 12, 12) << 9 | get_num(c, 6, 6) << 4 | get_num(c, 5, 5) << 6 | get_num(c, 3, 4) << 7 | get_num(c, 2, 2) << 5, 10);
+                        return imm ? I(imm, 2, 0, 2, 0x13) : 0;
+                    }
+                    return imm6 ? (imm6 & 0xfffff) << 12 | rd << 7 | 0x37 : 0;
+                }
+                case 4: {
+                    unsigned int f2 = get_num(c, 10, 11);
+                    if (f2 == 0) return get_num(c, 12, 12) ? 0 : I(rs2, rs1p, 5, rs1p, 0x13);
+                    if (f2 == 1) return get_num(c, 12, 12) ? 0 : I(0x400 | rs2, rs1p, 5, rs1p, 0x13);
+                    if (f2 == 2) return I(imm6, rs1p, 7, rs1p, 0x13);
+                    if (get_num(c, 12, 12)) return 0;
+                    static const unsigned int f[4] = {0, 4, 6, 7};
+                    unsigned int k = get_num(c, 5, 6);
+                    return R(k ? 0 : 0x20, rdp, rs1p, f[k], rs1p);
+                }
+                case 5: return J(j_imm(c), 0);
+                case 6: return B(b_imm(c), rs1p, 0);
+                case 7: return B(b_imm(c), rs1p, 1);
+            }
+            return 0;
         }
-        else if (opcode == 0x13) {
-            if (funct3 == 0) op = 18;
-            else if (funct3 == 2) op = 19;
-            else if (funct3 == 3) op = 20;
-            else if (funct3 == 4) op = 21;
-            else if (funct3 == 6) op = 22;
-            else if (funct3 == 7) op = 23;
-            else if (funct3 == 1) op = 24;
-            else if (funct3 == 5) {
-                if ((ins >> 30) ^ 1) op = 25;
-                else op = 26, imm ^= (1 << 10);
+        case 2: {
+            if (f3 == 0) return get_num(c, 12, 12) ? 0 : I(rs2, rd, 1, rd, 0x13);
+            if (f3 == 2) return rd ? I(get_num(c, 12, 12) << 5 | get_num(c, 4, 6) << 2 | get_num(c, 2, 3) << 6, 2, 2, rd, 0x03) : 0;
+            if (f3 == 6) return S(get_num(c, 9, 12) << 2 | get_num(c, 7, 8) << 6, rs2, 2, 2);
+            if (f3 != 4) return 0;
+            if (!get_num(c, 12, 12)) {
+                if (!rs2) return rd ? I(0, rd, 0, 0, 0x67) : 0;
+                return R(0, rs2, 0, 0, rd);
             }
+            if (!rs2) return rd ? I(0, rd, 0, 1, 0x67) : 0; // c.ebreak is not supported
+            return R(0, rs2, rd, 0, rd);
         }
     }
+    return 0;
+}
+
+// Formats and functional-unit classes of the ops, fixed at compile time
+enum Format { kFmtU, kFmtJ, kFmtI, kFmtB, kFmtS, kFmtR, kFmtA, kFmtSys };
+enum FUclass { kALU, kBRU, kMUL, kDIV, kAGU, FUnum };
+static string FUnames[FUnum] = {"alu", "bru", "mul", "div", "agu"};
+
+struct OpInfo { uint8_t fmt, fu; };
+
+constexpr OpInfo op_info(int op) {
+    if (op <= 1) return {kFmtU, kALU};
+    if (op == 2) return {kFmtJ, kBRU};
+    if (op == 3) return {kFmtI, kBRU};
+    if (op <= 9) return {kFmtB, kBRU};
+    if (op <= 14) return {kFmtI, kAGU};
+    if (op <= 17) return {kFmtS, kAGU};
+    if (op <= 26) return {kFmtI, kALU};
+    if (op <= 36) return {kFmtR, kALU};
+    if (op <= 40) return {kFmtR, kMUL};
+    if (op <= 44) return {kFmtR, kDIV};
+    if (op <= 55) return {kFmtA, kAGU};
+    if (op == 56) return {kFmtSys, kALU};
+    if (op <= 69) return {kFmtR, kALU};
+    if (op <= 77) return {kFmtI, kALU};
+    return {kFmtSys, kALU};
+}
+
+constexpr std::array<OpInfo, funcNum> make_op_info() {
+    std::array<OpInfo, funcNum> t{};
+    for (int op = 0; op < funcNum; ++op) t[op] = op_info(op);
+    return t;
+}
+inline constexpr std::array<OpInfo, funcNum> opInfo = make_op_info();
+
+inline bool is_U(int op) { return opInfo[op].fmt == kFmtU; }
+inline bool is_J(int op) { return opInfo[op].fmt == kFmtJ; }
+inline bool is_I(int op) { return opInfo[op].fmt == kFmtI; }
+inline bool is_B(int op) { return opInfo[op].fmt == kFmtB; }
+inline bool is_S(int op) { return opInfo[op].fmt == kFmtS; }
+inline bool is_R(int op) { return opInfo[op].fmt == kFmtR; }
+inline bool is_A(int op) { return opInfo[op].fmt == kFmtA; }
+inline int fu_class(int op) { return opInfo[op].fu; }
+
+// Op by (opcode, funct3, funct7), funct7 folded to 0: 0x00, 1: 0x20, 2: 0x01, 3: 0x10, 4: 0x05,
+// 5: 0x30, 6: 0x04, 7: anything else.
+// kIllegal marks encodings no engine implements; kAmo, kFence and kUnary are resolved in decode.
+const static int kIllegal = 0xff, kAmo = 0xfe, kFence = 0xfd, kUnary = 0xfc;
+
+constexpr std::array<uint8_t, 2048> make_decode_table() {
+    std::array<uint8_t, 2048> t{};
+    for (auto &e : t) e = kIllegal;
+    auto set = [&t](unsigned opcode, int f3, int f7, int op) { // f3, f7 < 0: any
+        for (int a = 0; a < 8; ++a)
+            for (int b = 0; b < 8; ++b)
+                if ((f3 < 0 || a == f3) && (f7 < 0 || b == f7)) t[(opcode >> 2) << 6 | a << 3 | b] = op;
+    };
+    set(0x37, -1, -1, 0); set(0x17, -1, -1, 1); set(0x6f, -1, -1, 2); set(0x67, 0, -1, 3);
+    const int branch[] = {0, 1, 4, 5, 6, 7}, load[] = {0, 1, 2, 4, 5};
+    for (int k = 0; k < 6; ++k) set(0x63, branch[k], -1, 4 + k);
+    for (int k = 0; k < 5; ++k) set(0x03, load[k], -1, 10 + k);
+    for (int k = 0; k < 3; ++k) set(0x23, k, -1, 15 + k);
+    const int opimm[] = {0, 2, 3, 4, 6, 7};
+    for (int k = 0; k < 6; ++k) set(0x13, opimm[k], -1, 18 + k);
+    set(0x13, 1, 0, 24); set(0x13, 5, 0, 25); set(0x13, 5, 1, 26);
+    const int op[] = {27, 29, 30, 31, 32, 33, 35, 36};
+    for (int k = 0; k < 8; ++k) set(0x33, k, 0, op[k]), set(0x33, k, 2, 37 + k);
+    set(0x33, 0, 1, 28); set(0x33, 5, 1, 34);
+    // Zba, Zbb
+    set(0x33, 2, 3, 57); set(0x33, 4, 3, 58); set(0x33, 6, 3, 59);
+    set(0x33, 7, 1, 60); set(0x33, 6, 1, 61); set(0x33, 4, 1, 62);
+    for (int k = 0; k < 4; ++k) set(0x33, 4 + k, 4, 63 + k);
+    set(0x33, 1, 5, 67); set(0x33, 5, 5, 68); set(0x13, 5, 5, 77);
+    set(0x33, 4, 6, kUnary); set(0x13, 1, 5, kUnary); set(0x13, 5, 7, kUnary);
+    set(0x2f, 2, -1, kAmo);
+    set(0x0f, 0, -1, kFence); set(0x0f, 1, -1, 78);
+    set(0x73, 0, 0, 56);
+    return t;
+}
+inline constexpr std::array<uint8_t, 2048> decodeTable = make_decode_table();
+constexpr std::array<uint8_t, 128> make_funct7_table() {
+    std::array<uint8_t, 128> t{};
+    for (auto &e : t) e = 7;
+    t[0x00] = 0; t[0x20] = 1; t[0x01] = 2; t[0x10] = 3; t[0x05] = 4; t[0x30] = 5; t[0x04] = 6;
+    return t;
+}
+inline constexpr std::array<uint8_t, 128> funct7Table = make_funct7_table();
+
+// Decoded instruction: registers, the sign-extended immediate (U-type already
+// shifted into place) and the op's format and unit copied from opInfo.
+struct MicroOp {
+    int32_t imm;
+    uint8_t op, rd, rs1, rs2;
+    uint8_t fmt, fu, len; // len: 2 for an expanded RV32C instruction
+    uint8_t reads; // 1: rs1, 2: rs2
+    bool valid() const { return op != kIllegal; }
+    bool is_U() const { return fmt == kFmtU; }
+    bool is_J() const { return fmt == kFmtJ; }
+    bool is_I() const { return fmt == kFmtI; }
+    bool is_B() const { return fmt == kFmtB; }
+    bool is_S() const { return fmt == kFmtS; }
+    bool is_R() const { return fmt == kFmtR; }
+    bool is_A() const { return fmt == kFmtA; }
+    bool writes() const { return fmt != kFmtB && fmt != kFmtS; }
+    void print() const { std::cerr << std::dec << funcs[op] << ' ' << (int)rs1 << ' ' << (int)rs2 << ' ' << (int)rd << ' ' << imm << '\n'; }
 };
-struct S_type: public instruction {
-    unsigned int imm : 12;
-    unsigned int rs2 : 5;
-    unsigned int rs1 : 5;
-    unsigned int get_rd() override { return 0; }
-    unsigned int get_rs1() override { return rs1; }
-    unsigned int get_rs2() override { return rs2; }
-    unsigned int get_imm() override { return imm; }
-    S_type(unsigned int ins) {
-        unsigned int funct3 = (ins >> 12) & 0x7;
-        rs1 = (ins >> 15) & 0x1f;
-        rs2 = (ins >> 20) & 0x1f;
-        imm = (ins >> 7) & 0x1f;
-        imm |= get_num(ins, 25, 31) << 5;
-        if (funct3 == 0) op = 15;
-        else if (funct3 == 1) op = 16;
-        else if (funct3 == 2) op = 17;
-    }
-};
-struct B_type: public instruction {
-    unsigned int imm : 13;
-    unsigned int rs2 : 5;
-    unsigned int rs1 : 5;
-    unsigned int get_rd() override { return 0; }
-    unsigned int get_rs1() override { return rs1; }
-    unsigned int get_rs2() override { return rs2; }
-    unsigned int get_imm() override { return imm; }
-    B_type(unsigned int ins) {
-        unsigned int funct3 = (ins >> 12) & 0x7;
-        if (funct3 == 0) { op = 4; }
-        else if (funct3 == 1) { op = 5; }
-        else if (funct3 == 4) { op = 6; }
-        else if (funct3 == 5) { op = 7; }
-        else if (funct3 == 6) { op = 8; }
-        else if (funct3 == 7) { op = 9; }
-        rs1 = (ins >> 15) & 0x1f;
-        rs2 = (ins >> 20) & 0x1f;
-        imm = 0;
-        imm |= ((ins >> 8) & 0xf) << 1;
-        imm |= get_num(ins, 25, 30) << 5;
-        imm |= ((ins >> 7) & 1) << 11;
-        imm |= ((ins >> 31) &1) << 12;
-    }
-};
-struct U_type: public instruction{
-    unsigned int imm : 20;
-    unsigned int rd : 5;
-    unsigned int get_rd() override { return rd; }
-    unsigned int get_rs1() override { return 0; }
-    unsigned int get_rs2() override { return 0; }
-    unsigned int get_imm() override { return imm; }
-    U_type(unsigned int ins) {
-        if ((ins & 0x7f) == 0x37) op = 0;
-        else op = 1;
-        rd = (ins >> 7) & 0x1f;
-        imm = (ins >> 12) & 0xfffff;
-    }
-};
-struct J_type: public instruction {
-    unsigned int imm : 21;
-    unsigned int rd : 5;
-    unsigned int get_rd() override { return rd; }
-    unsigned int get_rs1() override { return 0; }
-    unsigned int get_rs2() override { return 0; }
-    unsigned int get_imm() override { return imm; }
-    J_type(unsigned int ins) {
-        op = 2;
-        rd = (ins >> 7) & 0x1f;
-        imm = 0;
-        imm |= ((ins >> 21) & 0x3ff) << 1;
-        imm |= ((ins >> 20) & 1) << 11;
-        imm |= ((ins >> 12) & 0xff) << 12;
-        imm |= ((ins >> 31) & 1) << 20;
+static_assert(sizeof(MicroOp) == 12 && std::is_trivial_v<MicroOp> && std::is_standard_layout_v<MicroOp>);
+
+inline MicroOp decode(unsigned int ins) {
+    MicroOp o{};
+    o.len = ins_len(ins);
+    if (o.len == 2) ins = expand(ins & 0xffff);
+    int op = decodeTable[(ins >> 2 & 0x1f) << 6 | (ins >> 12 & 7) << 3 | funct7Table[ins >> 25]];
+    if ((ins & 3) != 3) op = kIllegal;
+    else if (op == kAmo) op = amo_op(ins) < 0 ? kIllegal : amo_op(ins);
+    else if (op == kUnary) op = unary_op(ins) < 0 ? kIllegal : unary_op(ins);
+    else if (op == kFence) ins = 0x13, op = 18; // harts see memory in commit order, so a nop
+    else if (op == 56 && ins != 0x73) op = kIllegal; // ecall only
+    o.op = op;
+    if (op == kIllegal) return o;
+    o.fmt = opInfo[op].fmt; o.fu = opInfo[op].fu;
+    o.rd = ins >> 7 & 0x1f; o.rs1 = ins >> 15 & 0x1f; o.rs2 = ins >> 20 & 0x1f;
+    switch (o.fmt) {
+        case kFmtU: o.imm = ins & 0xfffff000u; o.rs1 = o.rs2 = 0; break;
+        case kFmtJ:
+            o.imm = sext(get_num(ins, 31, 31) << 20 | get_num(ins, 12, 19) << 12 | get_num(ins, 20, 20) << 11 | get_num(ins, 21, 30) << 1, 21);
+            o.rs1 = o.rs2 = 0;
+            break;
+        case kFmtI: o.imm = (int)ins >> 20; o.rs2 = 0; o.reads = 1; if ((op >= 24 && op <= 26) || op == 77) o.imm &= 0x1f; break;
+        case kFmtB:
+            o.imm = sext(get_num(ins, 31, 31) << 12 | get_num(ins, 7, 7) << 11 | get_num(ins, 25, 30) << 5 | get_num(ins, 8, 11) << 1, 13);
+            o.rd = 0; o.reads = 3;
+            break;
+        case kFmtS: o.imm = (int)ins >> 25 << 5 | (ins >> 7 & 0x1f); o.rd = 0; o.reads = 3; break;
+        case kFmtR: case kFmtA: o.reads = 3; break;
+        case kFmtSys: o.rd = op == 56 ? 10 : 0; o.rs1 = o.rs2 = 0; break; // the call's result lands in a0
     }
-};
+    return o;
+}
 }
 #endif
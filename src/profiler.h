@@ -0,0 +1,141 @@
+#ifndef RISC_V_PROFILER_H
+#define RISC_V_PROFILER_H
+
+#include "parser.h"
+#include "memory.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdint>
+
+namespace hst {
+
+extern Memory Mem;
+
+// Guest hot-spot profiler. Every cycle is charged to the pc at the RoB head, or
+// while the RoB is empty (fetch stalls, flush penalties) to the last retired pc.
+// Cycles are keyed by pc and calling context, a node of a call tree grown from
+// the retired calls and returns. Both tables are fixed size; collection never allocates.
+class Profiler {
+private:
+    const static int slotBits = 16, nodeBits = 12;
+    const static int slots = 1 << slotBits, nodes = 1 << nodeBits;
+    struct slot { uint64_t key; long long cycles, retired; };
+    struct node { int parent; unsigned callee; };
+    slot table[slots] = {};
+    node tree[nodes] = {{0, 0}};
+    int child[2 * nodes] = {}; // (parent, callee) -> node + 1, open addressing
+    int treeSize = 1, cur = 0;
+    bool calling = false;
+    unsigned last = 0;
+    long long dropped = 0, total = 0;
+    Memory *m;
+    std::vector<std::pair<unsigned, string>> syms; // sorted by address
+
+    static unsigned hash(uint64_t k) { return (k * 0x9e3779b97f4a7c15ull) >> (64 - slotBits); }
+    slot *find(unsigned pc) {
+        uint64_t k = (uint64_t)cur << 32 | pc;
+        for (unsigned i = hash(k), n = 0; n < slots; i = (i + 1) & (slots - 1), ++n) {
+            if (table[i].key == k + 1) return &table[i];
+            if (!table[i].key) { table[i].key = k + 1; return &table[i]; }
+        }
+        return nullptr;
+    }
+    int enter(unsigned callee) {
+        uint64_t k = (uint64_t)cur << 32 | callee;
+        for (unsigned i = hash(k) & (2 * nodes - 1); ; i = (i + 1) & (2 * nodes - 1)) {
+            int c = child[i] - 1;
+            if (c >= 0 && tree[c].parent == cur && tree[c].callee == callee) return c;
+            if (c < 0) {
+                if (treeSize == nodes) return cur; // full: stay in the caller
+                tree[treeSize] = {cur, callee};
+                child[i] = treeSize + 1;
+                return treeSize++;
+            }
+        }
+    }
+    string symbol(unsigned pc) {
+        auto it = std::upper_bound(syms.begin(), syms.end(), std::make_pair(pc, string("\xff")));
+        if (it == syms.begin()) { std::ostringstream s; s << "0x" << std::hex << pc; return s.str(); }
+        return (--it)->second;
+    }
+    string stack(int n) { // the root stands for the code entered at reset
+        std::vector<int> path;
+        for (; n; n = tree[n].parent) path.push_back(n);
+        string s = symbol(tree[0].callee);
+        for (auto it = path.rbegin(); it != path.rend(); ++it) s.append(1, ';').append(symbol(tree[*it].callee));
+        return s;
+    }
+public:
+    Profiler(Memory *m_ = &Mem): m(m_) {}
+    // nm-style lines: "<hex address> <type> <name>"; only text symbols are kept
+    bool load_symbols(const char *file) {
+        std::ifstream in(file);
+        if (!in) return false;
+        string line, addr, type, name;
+        while (std::getline(in, line)) {
+            std::istringstream s(line);
+            if (!(s >> addr >> type >> name) || (type != "T" && type != "t")) continue;
+            syms.push_back({(unsigned)std::stoul(addr, nullptr, 16), name});
+        }
+        std::sort(syms.begin(), syms.end());
+        return true;
+    }
+    // once per cycle from commit with the pc at the RoB head, if there is one; n for skipped idle cycles
+    void cycle(bool empty, unsigned pc, long long n = 1) {
+        slot *s = find(empty ? last : pc);
+        if (s) s->cycles += n; else dropped += n;
+        total += n;
+    }
+    void retire(int op, int rd, unsigned pc) {
+        if (calling) cur = enter(pc), calling = false;
+        last = pc;
+        if (slot *s = find(pc)) ++s->retired;
+        if (op != 2 && op != 3) return;
+        // RISC-V calling convention: link register ra or t0
+        auto link = [](int r) { return r == 1 || r == 5; };
+        int rs1 = -1;
+        if (op == 3) {
+            unsigned ins = m->fetch(pc);
+            if (ins_len(ins) == 2) ins = expand(ins & 0xffff);
+            rs1 = (ins >> 15) & 0x1f;
+        }
+        if (op == 3 && !rd && link(rs1) && cur) cur = tree[cur].parent;
+        if (link(rd)) calling = true;
+    }
+    void report(std::ostream &out, const char *collapsed) {
+        std::map<string, std::pair<long long, long long>> flat;
+        std::map<string, long long> folded;
+        for (int i = 0; i < slots; ++i) {
+            if (!table[i].key) continue;
+            unsigned pc = (table[i].key - 1) & 0xffffffffu;
+            int n = (table[i].key - 1) >> 32;
+            string f = symbol(pc);
+            flat[f].first += table[i].cycles; flat[f].second += table[i].retired;
+            string s = stack(n);
+            if (symbol(tree[n].callee) != f) s += ";" + f;
+            folded[s] += table[i].cycles;
+        }
+        std::vector<std::pair<long long, string>> rows;
+        for (auto &e : flat) rows.push_back({e.second.first, e.first});
+        std::sort(rows.rbegin(), rows.rend());
+        out << "profile: " << total << " cycles";
+        if (dropped) out << " (" << dropped << " not attributed, table full)";
+        out << "\n      cycles       %    retired    cpi  function\n";
+        for (auto &r : rows) {
+            long long ret = flat[r.second].second;
+            char buf[96];
+            snprintf(buf, sizeof buf, "%12lld %6.2f%% %10lld %6.2f  ", r.first, 100.0 * r.first / std::max(1ll, total), ret, ret ? (double)r.first / ret : 0.0);
+            out << buf << r.second << '\n';
+        }
+        if (!collapsed) return;
+        std::ofstream f(collapsed);
+        for (auto &e : folded) if (e.second) f << e.first << ' ' << e.second << '\n';
+    }
+};
+
+}
+#endif
@@ -0,0 +1,96 @@
+#ifndef RISC_V_SERVER_H
+#define RISC_V_SERVER_H
+
+#include "cpu.h"
+#include "memory.h"
+#include "hostio.h"
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <csignal>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace hst {
+
+// Fork server: the image is loaded once, then each connection on a Unix socket is run by
+// a forked child, which starts from the loaded state with the memory shared copy-on-write.
+// Request: the input bytes, ended by shutting down the sending side of the connection.
+// Reply: one line "exit <status>", "halt <a0 & 255>" or "limit", then " cycles <n> output <len>",
+// followed by the guest's stdout.
+class ForkServer {
+private:
+    string path;
+    long long inject, limit; // inject: guest address of the input buffer, -1 for none; limit: cycles, 0 for none
+    cabbage_cpu *cpu;
+    Memory *m = &Mem;
+    static bool send(int fd, const void *p, size_t n) {
+        for (ssize_t k; n; n -= k, p = (const char *)p + k)
+            if ((k = write(fd, p, n)) <= 0) return false;
+        return true;
+    }
+    void serve(int fd) {
+        std::vector<unsigned char> in;
+        unsigned char buf[1 << 16];
+        for (ssize_t n; (n = read(fd, buf, sizeof buf)) > 0; ) in.insert(in.end(), buf, buf + n);
+        // the buffer: the input's length as a word, then its bytes
+        if (inject >= 0 && (in.size() > Memory::memSize || !m->write(inject + 4, in.data(), in.size()))) {
+            std::string e = "error input does not fit at the inject address\n";
+            send(fd, e.data(), e.size());
+            return;
+        }
+        if (inject >= 0) m->store32(inject, in.size());
+        Host.set_input(std::move(in));
+        FILE *out = tmpfile();
+        int null = open("/dev/null", O_WRONLY);
+        if (!out || null < 0) return;
+        dup2(fileno(out), 1); dup2(null, 2); // guest stdout is captured, stderr and statistics dropped
+        cpu->reset();
+        bool done = false;
+        while ((done = !cpu->step()) == false && (cpu->skip(limit ? limit : LLONG_MAX), !limit || cpu->cycles() < limit));
+        Host.flush(); fflush(stdout);
+        long len = ftell(out);
+        char head[96];
+        if (!done) snprintf(head, sizeof head, "limit");
+        else snprintf(head, sizeof head, "%s %u", cpu->exited() ? "exit" : "halt", cpu->result());
+        std::string reply = head + (" cycles " + std::to_string(cpu->cycles()) + " output " + std::to_string(len) + "\n");
+        if (!send(fd, reply.data(), reply.size())) return;
+        rewind(out);
+        for (size_t n; (n = fread(buf, 1, sizeof buf, out)) > 0; ) if (!send(fd, buf, n)) return;
+    }
+public:
+    ForkServer(const char *path_, long long inject_, long long limit_, cabbage_cpu *cpu_):
+        path(path_), inject(inject_), limit(limit_), cpu(cpu_) {}
+    int work() {
+        m->init();
+        int s = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un a = {};
+        a.sun_family = AF_UNIX;
+        if (s < 0 || path.size() >= sizeof a.sun_path) { std::cerr << "server: bad socket path " << path << '\n'; return 1; }
+        path.copy(a.sun_path, path.size());
+        unlink(path.c_str());
+        if (bind(s, (sockaddr *)&a, sizeof a) || listen(s, 64)) { perror("server"); return 1; }
+        signal(SIGCHLD, SIG_IGN); // children are reaped by the kernel
+        std::cerr << "server: listening on " << path << '\n';
+        while (true) {
+            int c = accept(s, nullptr, nullptr);
+            if (c < 0) { if (errno == EINTR) continue; perror("server"); return 1; }
+            pid_t pid = fork();
+            if (!pid) {
+                close(s);
+                signal(SIGPIPE, SIG_IGN);
+                serve(c);
+                _exit(0);
+            }
+            if (pid < 0) perror("server");
+            close(c);
+        }
+    }
+};
+
+}
+#endif
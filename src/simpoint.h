@@ -0,0 +1,236 @@
+#ifndef RISC_V_SIMPOINT_H
+#define RISC_V_SIMPOINT_H
+
+#include "parser.h"
+#include "cpu.h"
+#include "memory.h"
+#include "hostio.h"
+#include "devices.h"
+#include "checker.h"
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <array>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+namespace hst {
+
+// SimPoint-style sampling: a functional pass of the checker's reference model collects
+// a basic-block vector per interval, k-means picks clusters of similar intervals, and a few intervals of
+// each cluster are replayed in detail from checkpoints, in parallel. The CPI of
+// each cluster is weighted by its share of instructions; the spread between
+// samples of the same cluster gives the error bound.
+class SimPoint {
+private:
+    const static int dims = 32; // basic blocks are hashed into this many dimensions
+    typedef std::array<double, dims> vec;
+    struct Checkpoint {
+        unsigned x[32], pc;
+        long long at;
+        std::shared_ptr<HostIO> io; // input position and break
+        std::vector<unsigned> pages;
+        std::vector<unsigned char> bytes;
+    };
+    struct Sample {
+        int interval;
+        long long warm, len; // instructions to warm up on, then to measure
+        long long cycles = 0, measured = 0;
+        Checkpoint ck;
+    };
+    Memory *image = &Mem; // the loaded program, never run on
+    long long interval, warmup;
+    int clusters, samples, jobs;
+    std::vector<vec> bbv;
+    std::vector<long long> length; // instructions in each interval, the last may be short
+    std::vector<int> label;
+    std::vector<Sample> picked;
+    std::vector<int> cluster; // of each picked sample
+    unsigned result = 0;
+    bool exited = false;
+
+    static double dist(const vec &a, const vec &b) {
+        double s = 0;
+        for (int i = 0; i < dims; ++i) s += (a[i] - b[i]) * (a[i] - b[i]);
+        return s;
+    }
+    static unsigned bucket(unsigned pc) { return (pc * 0x9e3779b1u) >> 27; }
+
+    void profile() {
+        auto m = std::make_unique<Memory>();
+        m->copy(*image);
+        HostIO io; // the only pass whose output is kept
+        io.copy(Host);
+        Checker f(m.get(), &io);
+        Devices dev(&io, [&] { return f.count(); });
+        dev.attach(m.get());
+        vec v{};
+        unsigned start = 0;
+        long long blk = 0, n = 0;
+        auto close = [&]() {
+            for (auto &e : v) e /= n;
+            bbv.push_back(v); length.push_back(n);
+            v = vec{}; n = 0;
+        };
+        for (int r; (r = f.execute()) >= 0; ) {
+            ++blk; ++n;
+            if (r) v[bucket(start)] += blk, blk = 0, start = f.where();
+            if (n == interval) v[bucket(start)] += blk, blk = 0, close();
+        }
+        if (n) v[bucket(start)] += blk, close();
+        result = f.regs()[10] & 255u; exited = f.exited();
+    }
+    void cluster_intervals() {
+        int n = bbv.size(), k = std::min(clusters, n);
+        std::mt19937 rnd(1);
+        std::vector<vec> c;
+        std::vector<double> d(n, 1e300);
+        c.push_back(bbv[rnd() % n]);
+        while ((int)c.size() < k) { // k-means++ seeding
+            double sum = 0;
+            for (int i = 0; i < n; ++i) sum += d[i] = std::min(d[i], dist(bbv[i], c.back()));
+            if (sum == 0) break;
+            double t = std::uniform_real_distribution<double>(0, sum)(rnd);
+            int i = 0;
+            while (i + 1 < n && (t -= d[i]) > 0) ++i;
+            c.push_back(bbv[i]);
+        }
+        k = c.size();
+        label.assign(n, 0);
+        for (int it = 0; it < 100; ++it) {
+            bool changed = false;
+            for (int i = 0; i < n; ++i) {
+                int b = 0;
+                for (int j = 1; j < k; ++j) if (dist(bbv[i], c[j]) < dist(bbv[i], c[b])) b = j;
+                if (b != label[i]) label[i] = b, changed = true;
+            }
+            if (!changed && it) break;
+            std::vector<vec> s(k, vec{});
+            std::vector<int> cnt(k, 0);
+            for (int i = 0; i < n; ++i) { ++cnt[label[i]]; for (int j = 0; j < dims; ++j) s[label[i]][j] += bbv[i][j]; }
+            for (int j = 0; j < k; ++j) if (cnt[j]) for (int e = 0; e < dims; ++e) c[j][e] = s[j][e] / cnt[j];
+        }
+        // the interval nearest each centroid, then random members for the error bound
+        for (int j = 0; j < k; ++j) {
+            std::vector<int> mem;
+            for (int i = 0; i < n; ++i) if (label[i] == j) mem.push_back(i);
+            if (mem.empty()) continue;
+            std::sort(mem.begin(), mem.end(), [&](int a, int b) { return dist(bbv[a], c[j]) < dist(bbv[b], c[j]); });
+            std::shuffle(mem.begin() + 1, mem.end(), rnd);
+            for (int s = 0; s < std::min<int>(samples, mem.size()); ++s) {
+                Sample p;
+                p.interval = mem[s];
+                p.warm = std::min(warmup, mem[s] * interval);
+                p.len = length[mem[s]];
+                picked.push_back(p); cluster.push_back(j);
+            }
+        }
+    }
+    // a second functional pass stops at every sample's warm-up start; the pages that
+    // differ from the image are saved
+    void checkpoint() {
+        auto m = std::make_unique<Memory>();
+        m->copy(*image);
+        HostIO io;
+        io.copy(Host); io.sink = true;
+        Checker f(m.get(), &io);
+        Devices dev(&io, [&] { return f.count(); });
+        dev.attach(m.get());
+        std::vector<int> order(picked.size());
+        for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+        auto at = [&](int i) { return picked[i].interval * interval - picked[i].warm; };
+        std::sort(order.begin(), order.end(), [&](int a, int b) { return at(a) < at(b); });
+        for (int i : order) {
+            while (f.count() < at(i) && f.execute() >= 0);
+            Checkpoint &c = picked[i].ck;
+            std::copy(f.regs(), f.regs() + 32, c.x); c.pc = f.where(); c.at = f.count();
+            c.io = std::make_shared<HostIO>(); c.io->copy(io); c.io->sink = true;
+            for (unsigned p = 0; p < Memory::pages; ++p) if (!m->same_page(*image, p)) {
+                c.pages.push_back(p);
+                c.bytes.resize(c.bytes.size() + Memory::pageSize);
+                m->read_page(p, c.bytes.data() + c.bytes.size() - Memory::pageSize);
+            }
+        }
+    }
+    void replay(Sample &s) {
+        auto m = std::make_unique<Memory>();
+        m->copy(*image);
+        for (size_t i = 0; i < s.ck.pages.size(); ++i) m->write_page(s.ck.pages[i], s.ck.bytes.data() + i * Memory::pageSize);
+        auto c = std::make_unique<cabbage_cpu>(0, m.get(), s.ck.io.get());
+        Devices dev(s.ck.io.get(), [&] { return s.ck.at + c->cycles(); }); // instructions up to the checkpoint, then cycles
+        dev.attach(m.get());
+        long long n = 0, begin = 0;
+        c->set_retire([&](const RoBdata &) { if (++n == s.warm) begin = c->cycles(); });
+        c->reset(s.ck.pc, s.ck.x);
+        while (n < s.warm + s.len && c->step()) c->skip();
+        s.measured = n - s.warm;
+        s.cycles = c->cycles() - begin;
+    }
+public:
+    SimPoint(long long interval_, int clusters_, long long warmup_, int samples_, int jobs_):
+        interval(interval_), warmup(warmup_), clusters(clusters_), samples(samples_), jobs(jobs_) {}
+    // the program's exit status if it called exit, else 0, as for a detailed run
+    int work() {
+        auto t0 = std::chrono::steady_clock::now();
+        image->init();
+        profile();
+        cluster_intervals();
+        checkpoint();
+        auto t1 = std::chrono::steady_clock::now();
+        std::atomic<size_t> next{0};
+        std::vector<std::thread> threads;
+        for (int j = 0; j < std::max(1, jobs); ++j) threads.emplace_back([&]() {
+            for (size_t i; (i = next++) < picked.size(); ) replay(picked[i]);
+        });
+        for (auto &t : threads) t.join();
+        auto t2 = std::chrono::steady_clock::now();
+
+        // stratified estimate: cluster mean CPI weighted by the cluster's instructions
+        int k = 0;
+        for (int j : cluster) k = std::max(k, j + 1);
+        long long total = 0;
+        for (long long l : length) total += l;
+        // a cluster replayed only once takes the pooled variance of the others
+        double cpi = 0, var = 0, pooled = 0;
+        long long dof = 0;
+        std::vector<double> wt(k, 0);
+        std::vector<std::vector<double>> y(k);
+        for (size_t i = 0; i < label.size(); ++i) wt[label[i]] += (double)length[i] / total;
+        for (size_t i = 0; i < picked.size(); ++i)
+            if (picked[i].measured) y[cluster[i]].push_back((double)picked[i].cycles / picked[i].measured);
+        std::vector<double> mean(k, 0), s2(k, 0);
+        for (int j = 0; j < k; ++j) {
+            if (y[j].empty()) continue;
+            for (double e : y[j]) mean[j] += e;
+            mean[j] /= y[j].size();
+            for (double e : y[j]) s2[j] += (e - mean[j]) * (e - mean[j]);
+            pooled += s2[j]; dof += y[j].size() - 1;
+        }
+        int single = 0;
+        for (int j = 0; j < k; ++j) {
+            if (y[j].empty()) continue;
+            double v = y[j].size() > 1 ? s2[j] / (y[j].size() - 1) : dof ? pooled / dof : 0;
+            single += y[j].size() == 1;
+            var += wt[j] * wt[j] * v / y[j].size();
+            cpi += wt[j] * mean[j];
+            std::cerr << "cluster " << j << ": weight " << wt[j] << ", cpi";
+            for (double e : y[j]) std::cerr << ' ' << e;
+            std::cerr << '\n';
+        }
+        if (!exited) cout << std::dec << result << '\n';
+        std::cerr << "simpoint: " << total << " instructions in " << length.size() << " intervals of " << interval
+                  << ", " << k << " clusters, " << picked.size() << " intervals replayed\n";
+        std::cerr << "estimated cpi: " << cpi << " +- " << 1.96 * std::sqrt(var) << " (95%), ipc " << 1 / cpi << '\n';
+        if (single) std::cerr << "  " << single << " clusters replayed once: " << (dof ? "pooled within-cluster variance used" : "not in the bound, no cluster has two samples") << '\n';
+        std::cerr << "profile and checkpoints: " << std::chrono::duration<double>(t1 - t0).count() << " s, detailed replay: "
+                  << std::chrono::duration<double>(t2 - t1).count() << " s\n";
+        return exited ? result : 0;
+    }
+};
+
+}
+#endif
@@ -0,0 +1,34 @@
+.text
+.option norelax
+.equ NH, 1
+  mv s0, a0
+  li s1, 0x1000
+  li t0, 100
+1: li t1, 1
+  amoadd.w zero, t1, (s1)
+  addi t0, t0, -1
+  bnez t0, 1b
+  li t0, 100
+  addi s2, s1, 4
+2: lr.w t1, (s2)
+  addi t1, t1, 1
+  sc.w t2, t1, (s2)
+  bnez t2, 2b
+  addi t0, t0, -1
+  bnez t0, 2b
+  li t3, 7
+  amomaxu.w t4, t3, (s1)
+  li t3, 1
+  addi s3, s1, 8
+  fence
+  amoadd.w zero, t3, (s3)
+  bnez s0, 9f
+  li t3, NH
+3: lw t4, 0(s3)
+  bne t4, t3, 3b
+  lw a0, 0(s1)
+  lw t5, 4(s1)
+  add a0, a0, t5
+  amoswap.w t6, zero, (s3)
+  add a0, a0, t6
+9: .word 0x0ff00513
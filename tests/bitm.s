@@ -0,0 +1,57 @@
+    li s0, 0x12345678      # x
+    li s1, 0               # h
+    li s2, 200             # iterations
+    li s3, 1103515245
+    li s4, 31
+loop:
+    mul s0, s0, s3
+    li t0, 12345
+    add s0, s0, t0
+    srli t1, s0, 7
+    xor t1, t1, s0         # y
+    andi t2, s2, 7
+    beqz t2, 1f
+    srli t3, s0, 13        # some inputs with leading/trailing zero bytes
+    and s5, s0, t3
+    j 2f
+1:  li s5, 0
+2:
+    .macro acc r
+    mul s1, s1, s4
+    add s1, s1, \r
+    .endm
+    sh1add a1, s0, t1; acc a1
+    sh2add a1, s0, t1; acc a1
+    sh3add a1, s0, t1; acc a1
+    andn a1, s0, t1; acc a1
+    orn a1, s0, t1; acc a1
+    xnor a1, s0, t1; acc a1
+    min a1, s0, t1; acc a1
+    minu a1, s0, t1; acc a1
+    max a1, s0, t1; acc a1
+    maxu a1, s0, t1; acc a1
+    rol a1, s0, t1; acc a1
+    ror a1, s0, t1; acc a1
+    zext.h a1, s0; acc a1
+    clz a1, s5; acc a1
+    ctz a1, s5; acc a1
+    cpop a1, s5; acc a1
+    sext.b a1, s0; acc a1
+    sext.h a1, s0; acc a1
+    orc.b a1, s5; acc a1
+    rev8 a1, s0; acc a1
+    rori a1, s0, 11; acc a1
+    rori a1, s0, 0; acc a1
+    clz a1, s0; acc a1
+    ctz a1, s0; acc a1
+    addi s2, s2, -1
+    bnez s2, loop
+    li t0, 0x8000
+    sw s1, 0(t0)
+    li a7, 64
+    li a0, 1
+    mv a1, t0
+    li a2, 4
+    ecall
+    mv a0, s1
+    .word 0x0ff00513
@@ -0,0 +1,30 @@
+.text
+.option norelax
+  lui sp, 0x20
+  li s0, 1
+  li s1, 300
+  li a0, 0
+1: mv t0, s0
+  li t2, 0
+2: li t3, 1
+  beq t0, t3, 4f
+  andi t1, t0, 1
+  beqz t1, 3f
+  slli t1, t0, 1
+  add t0, t0, t1
+  addi t0, t0, 1
+  addi t2, t2, 1
+  j 2b
+3: srli t0, t0, 1
+  addi t2, t2, 1
+  j 2b
+4: add a0, a0, t2
+  sltu t4, a0, s1
+  sltiu t5, t2, 50
+  add a0, a0, t4
+  sub a0, a0, t5
+  lui t6, 0x12345
+  auipc t6, 0
+  addi s0, s0, 1
+  bgeu s1, s0, 1b
+  .word 0x0ff00513
@@ -0,0 +1,25 @@
+.text
+.option norelax
+  lui sp, 0x20
+  li a0, 15
+  call fib
+  .word 0x0ff00513
+fib:
+  li t0, 2
+  blt a0, t0, 2f
+  addi sp, sp, -16
+  sw ra, 12(sp)
+  sw s0, 8(sp)
+  sw s1, 4(sp)
+  mv s0, a0
+  addi a0, a0, -1
+  call fib
+  mv s1, a0
+  addi a0, s0, -2
+  call fib
+  add a0, a0, s1
+  lw ra, 12(sp)
+  lw s0, 8(sp)
+  lw s1, 4(sp)
+  addi sp, sp, 16
+2: ret
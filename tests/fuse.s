@@ -0,0 +1,32 @@
+    .text
+    .globl _start
+_start:
+    li sp, 0x20000
+    li s0, 0          # sum
+    li s1, 0          # i
+    li s2, 300
+loop:
+    lui t0, %hi(0x12345678)
+    addi t0, t0, %lo(0x12345678)
+    add s0, s0, t0
+    slli t1, s0, 16
+    srli t1, t1, 16
+    xor s0, s0, t1
+    call func
+    addi s1, s1, 1
+    slt t2, s1, s2
+    bnez t2, loop
+    sltiu t3, s0, 5
+    beqz t3, skip
+    addi s0, s0, 7
+skip:
+    add s0, s0, t2
+    add s0, s0, t3
+    andi a0, s0, 255
+    .word 0x0ff00513
+func:
+    addi s0, s0, 3
+    sltu t4, s0, s1
+    beqz t4, 1f
+    addi s0, s0, 1
+1:  ret
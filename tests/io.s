@@ -0,0 +1,48 @@
+.text
+.option norelax
+  # brk(0) then grow by 4096: buffer at the old break
+  li a0, 0
+  li a7, 214
+  ecall
+  mv s0, a0
+  addi a0, a0, 1024
+  addi a0, a0, 1024
+  li a7, 214
+  ecall
+  sub s4, a0, s0
+  li s3, 0
+1: li a0, 0
+  mv a1, s0
+  li a2, 100
+  li a7, 63
+  ecall
+  blez a0, 3f
+  add s3, s3, a0
+  mv t0, s0
+  add t1, s0, a0
+2: lbu t2, 0(t0)
+  li t3, 97
+  bltu t2, t3, 4f
+  li t3, 123
+  bgeu t2, t3, 4f
+  addi t2, t2, -32
+  sb t2, 0(t0)
+4: addi t0, t0, 1
+  bne t0, t1, 2b
+  mv a2, a0
+  li a0, 1
+  mv a1, s0
+  li a7, 64
+  ecall
+  j 1b
+3: li a7, 113
+  ecall
+  snez s5, a0
+  # exit(bytes + (brk grew by 2048) + clock nonzero)
+  add a0, s3, s5
+  li t0, 2048
+  bne s4, t0, 5f
+  addi a0, a0, 100
+5: li a7, 93
+  ecall
+  .word 0x0ff00513
@@ -0,0 +1,62 @@
+.text
+.option norelax
+  lui sp, 0x20
+  li s0, 0
+  # table of operand pairs
+  la s1, tab
+  li s2, 12
+1: lw a1, 0(s1)
+  lw a2, 4(s1)
+  mul t0, a1, a2
+  add s0, s0, t0
+  mulh t0, a1, a2
+  xor s0, s0, t0
+  mulhsu t0, a1, a2
+  add s0, s0, t0
+  mulhu t0, a1, a2
+  xor s0, s0, t0
+  div t0, a1, a2
+  add s0, s0, t0
+  divu t0, a1, a2
+  xor s0, s0, t0
+  rem t0, a1, a2
+  add s0, s0, t0
+  remu t0, a1, a2
+  xor s0, s0, t0
+  slli t1, s0, 5
+  srli s0, s0, 27
+  or s0, s0, t1
+  addi s1, s1, 8
+  addi s2, s2, -1
+  bnez s2, 1b
+  # dependent div chain
+  li a1, 1000000007
+  li a2, 7
+  li t2, 20
+2: divu a1, a1, a2
+  mul a1, a1, a2
+  addi a1, a1, 13
+  addi t2, t2, -1
+  bnez t2, 2b
+  add s0, s0, a1
+  srli a0, s0, 8
+  xor a0, a0, s0
+  srli t0, s0, 16
+  xor a0, a0, t0
+  srli t0, s0, 24
+  xor a0, a0, t0
+  .word 0x0ff00513
+.align 2
+tab:
+  .word 7, 3
+  .word -7, 3
+  .word 7, -3
+  .word -7, -3
+  .word 0x80000000, -1
+  .word 5, 0
+  .word -5, 0
+  .word 0x80000000, 0x80000000
+  .word 0xffffffff, 0xffffffff
+  .word 0x12345678, 0x9abcdef0
+  .word 0, 0
+  .word 123456789, 1000
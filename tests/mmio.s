@@ -0,0 +1,22 @@
+    li t0, 0x10000000
+1:  lbu t1, 5(t0)
+    andi t1, t1, 0x20
+    beqz t1, 1b
+    li t1, 'o'
+    sb t1, 0(t0)
+    li t1, 'k'
+    sb t1, 0(t0)
+    li t1, 10
+    sb t1, 0(t0)
+    li t2, 0x0200bff8
+    lw a1, 0(t2)
+    lw a2, 4(t2)
+    li a3, 50
+2:  addi a3, a3, -1
+    bnez a3, 2b
+    lw a4, 0(t2)
+    sub a0, a4, a1
+    sltiu a0, a0, 40
+    xori a0, a0, 1
+    add a0, a0, a2
+    .word 0x0ff00513
@@ -0,0 +1,35 @@
+#!/bin/bash
+# Runs the guest programs in this directory on code under --check with the given options,
+# and on simple. Both must print <name>.out, whose last line is the exit status, and the
+# check must find no divergence. <name>.in, if present, is served to read on fd 0.
+# With --harts the programs in harts/ run instead, on code alone and without --check.
+#
+# The images are the .s sources built with llvm-mc -triple=riscv32 -mattr=+m,+a,+zba,+zbb
+# (c_<name>.data with +c as well) and llvm-objcopy -O binary, dumped as hex from @00000000.
+#
+# usage: run.sh <code> <simple> [code options]
+code=$1 simple=$2
+shift 2
+dir=$(dirname "$0")
+log=$(mktemp)
+trap 'rm -f "$log"' EXIT
+harts=
+for a in "$@"; do [ "$a" = --harts ] && harts=harts/; done
+fail=0
+# the program's stdout, then "exit <status>"
+run() { timeout 60 "$@" "${input[@]}" < "$data" 2> "$log"; echo "exit $?"; }
+for data in "$dir"/$harts*.data; do
+    name=${data%.data}
+    input=()
+    [ -f "$name.in" ] && input=(--input "$name.in")
+    expect=$(cat "$name.out")
+    if [ -n "$harts" ]; then
+        [ "$(run "$code" "$@")" = "$expect" ] || { echo "FAIL $name: $code $*"; cat "$log"; fail=1; }
+        continue
+    fi
+    if [ "$(run "$code" --check "$@")" != "$expect" ] || ! grep -q "no divergence" "$log"; then
+        echo "FAIL $name: $code --check $*"; tail -20 "$log"; fail=1
+    fi
+    [ "$(run "$simple")" = "$expect" ] || { echo "FAIL $name: $simple"; cat "$log"; fail=1; }
+done
+exit $fail
@@ -0,0 +1,21 @@
+.text
+.option norelax
+  # code patched by stores runs once fence.i has made fetch see them
+  li a0, 0
+  li s0, 20
+  la s1, 2f
+  lw s2, 0(s1)
+  li t0, 0x100000
+1: add s2, s2, t0      # the addi at 2f adds one more each time round
+  sw s2, 0(s1)
+  fence.i
+2: addi a0, a0, 0
+  addi s0, s0, -1
+  bnez s0, 1b
+  # straight-line code just ahead of the store, already fetched
+  la s1, 3f
+  li t0, 0x06450513    # addi a0, a0, 100
+  sw t0, 0(s1)
+  fence.i
+3: addi a0, a0, 1
+  .word 0x0ff00513
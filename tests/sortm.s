@@ -0,0 +1,61 @@
+.text
+.option norelax
+  lui sp, 0x20
+  # fill array at 0x10000 with pseudo-random halfwords, n=64
+  lui s0, 0x10
+  li s1, 64
+  li t0, 12345
+  li t1, 0
+1: slli t2, t1, 1
+  add t2, t2, s0
+  slli t3, t0, 3
+  xor t0, t0, t3
+  srli t3, t0, 5
+  xor t0, t0, t3
+  slli t3, t0, 7
+  xor t0, t0, t3
+  sh t0, 0(t2)
+  sb t0, 0x400(t2)
+  addi t1, t1, 1
+  blt t1, s1, 1b
+  # bubble sort signed halfwords
+  li t1, 0
+2: li t2, 0
+  sub t4, s1, t1
+  addi t4, t4, -1
+3: bge t2, t4, 5f
+  slli t5, t2, 1
+  add t5, t5, s0
+  lh a1, 0(t5)
+  lh a2, 2(t5)
+  bge a2, a1, 4f
+  sh a2, 0(t5)
+  sh a1, 2(t5)
+4: addi t2, t2, 1
+  j 3b
+5: addi t1, t1, 1
+  blt t1, s1, 2b
+  # checksum: sum of lhu * index + lb bytes
+  li a0, 0
+  li t1, 0
+6: slli t2, t1, 1
+  add t2, t2, s0
+  lhu a1, 0(t2)
+  mul a1, a1, t1
+  add a0, a0, a1
+  lb a2, 0x400(t2)
+  xor a0, a0, a2
+  lbu a2, 0x400(t2)
+  add a0, a0, a2
+  lh a3, 0(t2)
+  andi t6, t1, 15
+  addi t6, t6, 1
+  sra a3, a3, t6
+  add a0, a0, a3
+  addi t1, t1, 1
+  blt t1, s1, 6b
+  srli a1, a0, 8
+  xor a0, a0, a1
+  srli a1, a0, 16
+  xor a0, a0, a1
+  .word 0x0ff00513
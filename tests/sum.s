@@ -0,0 +1,9 @@
+.text
+.option norelax
+  li a0, 0
+  li t0, 1
+  li t1, 101
+1: add a0, a0, t0
+  addi t0, t0, 1
+  bne t0, t1, 1b
+  .word 0x0ff00513